@@ -70,6 +70,9 @@ bool MultiWordCompareAndSwap<T>::add_cas_triple(std::atomic<T> *address, T expec
 
 template<class T>
 bool MultiWordCompareAndSwap<T>::execute() {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(mcas)
+  #endif
   tervel::util::ProgressAssurance::check_for_announcement();
   bool res = mcas_complete(0);
   cleanup(res);
@@ -144,6 +144,9 @@ class Stack<T>::Accessor {
   */
 template<typename T>
 bool Stack<T>::push(T v) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(push)
+  #endif
   Node *elem = new Node(v);
 
   // When reading a node from the top of the stack, we must first apply the memory protection scheme.
@@ -177,6 +180,9 @@ bool Stack<T>::push(T v) {
   */
 template<typename T>
 bool Stack<T>::pop(T& v) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(pop)
+  #endif
   while (true) {
     Accessor access;
     if (access.load(&_stack) == false) {
@@ -0,0 +1,370 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_CONTAINER_WF_HASH_MAP_HASH_TRAITS_H
+#define TERVEL_CONTAINER_WF_HASH_MAP_HASH_TRAITS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+
+namespace tervel {
+namespace containers {
+namespace wf {
+
+/**
+ * The hash maps store the hashed key and use its bits, from the most
+ * significant bit of the first 64 bit word onwards, to select a position at
+ * each depth. A hash must therefore be a bijection, so that distinct keys have
+ * distinct hashes, and mix every bit of the key into the leading bits so that
+ * similar keys (small or sequential integers) are spread over the primary
+ * array instead of all sharing a bucket.
+ *
+ * hash_traits<Key> provides hash and its inverse, unhash. Keys which are 64
+ * bit integers use the murmur3 64 bit finalizer. 8, 16 and 32 bit integers
+ * are widened to 64 bits and then mixed the same way, so their hash is a
+ * uint64_t. Other trivially copyable keys whose size is a multiple of 64 bits
+ * first fold every word into the first word and then mix each word, so the
+ * first word depends on the whole key. Other keys are left unchanged.
+ * Specialize hash_traits to provide a hash for other key types.
+ */
+template<class Key, class Enable = void>
+struct hash_traits {
+  static Key hash(Key k) { return k; }
+  static Key unhash(Key k) { return k; }
+};
+
+namespace hash_detail {
+
+inline uint64_t mix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// The inverse of mix64, using the multiplicative inverses of its constants.
+inline uint64_t unmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0x9cb4b2f8129337dbULL;
+  k ^= k >> 33;
+  k *= 0x4f74430c22a54005ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t load64(const uint8_t *p) {
+  uint64_t res;
+  memcpy(&res, p, sizeof(res));
+  return res;
+}
+
+}  // namespace hash_detail
+
+/**
+ * A 128 bit hash, the hash maps take bits from high first.
+ */
+struct Hash128 {
+  uint64_t high;
+  uint64_t low;
+
+  bool operator==(const Hash128 &other) const {
+    return high == other.high && low == other.low;
+  }
+  bool operator!=(const Hash128 &other) const {
+    return !(*this == other);
+  }
+};
+
+/**
+ * Hashes len bytes with MurmurHash3 x64 128.
+ */
+inline Hash128 hash_bytes(const void *key, size_t len, uint64_t seed = 0) {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(key);
+  const size_t num_blocks = len / 16;
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+
+  for (size_t i = 0; i < num_blocks; i++) {
+    uint64_t k1 = hash_detail::load64(data + i * 16);
+    uint64_t k2 = hash_detail::load64(data + i * 16 + 8);
+
+    k1 *= c1; k1 = hash_detail::rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = hash_detail::rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = hash_detail::rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = hash_detail::rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const uint8_t *tail = data + num_blocks * 16;
+  const size_t tail_len = len & 15;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (size_t i = 0; i < tail_len; i++) {
+    if (i < 8) {
+      k1 ^= static_cast<uint64_t>(tail[i]) << (i * 8);
+    } else {
+      k2 ^= static_cast<uint64_t>(tail[i]) << ((i - 8) * 8);
+    }
+  }
+  if (tail_len > 8) {
+    k2 *= c2; k2 = hash_detail::rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+  }
+  if (tail_len > 0) {
+    k1 *= c1; k1 = hash_detail::rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = hash_detail::mix64(h1);
+  h2 = hash_detail::mix64(h2);
+  h1 += h2;
+  h2 += h1;
+  return Hash128{h1, h2};
+}
+
+template<class Key>
+struct hash_traits<Key, typename std::enable_if<
+    std::is_integral<Key>::value && sizeof(Key) == sizeof(uint64_t)>::type> {
+  static Key hash(Key k) {
+    return static_cast<Key>(hash_detail::mix64(static_cast<uint64_t>(k)));
+  }
+  static Key unhash(Key k) {
+    return static_cast<Key>(hash_detail::unmix64(static_cast<uint64_t>(k)));
+  }
+};
+
+template<class Key>
+struct hash_traits<Key, typename std::enable_if<
+    std::is_integral<Key>::value && !std::is_same<Key, bool>::value &&
+    sizeof(Key) < sizeof(uint64_t)>::type> {
+  // Keys are zero extended from their unsigned type, so that unhash can
+  // truncate the 64 bit value back to the key.
+  typedef typename std::make_unsigned<Key>::type unsigned_key;
+
+  static uint64_t hash(Key k) {
+    return hash_detail::mix64(static_cast<unsigned_key>(k));
+  }
+  static Key unhash(uint64_t h) {
+    return static_cast<Key>(static_cast<unsigned_key>(hash_detail::unmix64(h)));
+  }
+};
+
+template<class Key>
+struct hash_traits<Key, typename std::enable_if<
+    !std::is_integral<Key>::value && std::is_trivially_copyable<Key>::value &&
+    sizeof(Key) % sizeof(uint64_t) == 0>::type> {
+  static constexpr size_t NUM_WORDS = sizeof(Key) / sizeof(uint64_t);
+
+  static Key hash(Key k) {
+    uint64_t words[NUM_WORDS];
+    memcpy(words, &k, sizeof(Key));
+    // Each step only changes words[i - 1], by a function of words[i], so it
+    // can be undone.
+    for (size_t i = NUM_WORDS - 1; i > 0; i--) {
+      words[i - 1] ^= hash_detail::mix64(words[i]);
+    }
+    for (size_t i = 0; i < NUM_WORDS; i++) {
+      words[i] = hash_detail::mix64(words[i]);
+    }
+    memcpy(&k, words, sizeof(Key));
+    return k;
+  }
+
+  static Key unhash(Key k) {
+    uint64_t words[NUM_WORDS];
+    memcpy(words, &k, sizeof(Key));
+    for (size_t i = 0; i < NUM_WORDS; i++) {
+      words[i] = hash_detail::unmix64(words[i]);
+    }
+    for (size_t i = 1; i < NUM_WORDS; i++) {
+      words[i - 1] ^= hash_detail::mix64(words[i]);
+    }
+    memcpy(&k, words, sizeof(Key));
+    return k;
+  }
+};
+
+/**
+ * The default Functor, hashes keys with hash_traits.
+ */
+template<class Key, class Value, class Enable = void>
+struct default_functor {
+  Key hash(Key k) {
+    return hash_traits<Key>::hash(k);
+  }
+  Key unhash(Key k) {
+    return hash_traits<Key>::unhash(k);
+  }
+
+  bool key_equals(Key a, Key b) {
+    return a == b;
+  }
+};
+
+/**
+ * Integers narrower than 64 bits are hashed to a uint64_t, as positions are
+ * taken from 64 bit words. The hash is a bijection, so the key is recovered
+ * with unhash instead of being stored.
+ */
+template<class Key, class Value>
+struct default_functor<Key, Value, typename std::enable_if<
+    std::is_integral<Key>::value && !std::is_same<Key, bool>::value &&
+    sizeof(Key) < sizeof(uint64_t)>::type> {
+  typedef uint64_t hash_type;
+  static constexpr bool stores_key = false;
+
+  uint64_t hash(Key k) {
+    return hash_traits<Key>::hash(k);
+  }
+  Key unhash(uint64_t h) {
+    return hash_traits<Key>::unhash(h);
+  }
+
+  bool key_equals(uint64_t a, uint64_t b) {
+    return a == b;
+  }
+};
+
+/**
+ * Keys which cannot be hashed to a bijection, such as strings, use a functor
+ * which declares a hash_type:
+ *   -typedef hash_type (a trivially copyable type with operator==)
+ *   -hash_type hash(const Key &k)
+ *   -bool key_equals(const Key &a, const Key &b)
+ *       The keys themselves are passed in.
+ * The hash map then stores the key along with its hash, takes positions from
+ * the bits of the hash and only compares keys whose hashes are equal.
+ * A functor whose hash is a bijection into hash_type may also declare
+ *   -static constexpr bool stores_key = false
+ *   -Key unhash(hash_type h)
+ *   -bool key_equals(hash_type a, hash_type b)
+ * in which case only the hash is stored, as for functors without a hash_type.
+ */
+template<class Value>
+struct default_functor<std::string, Value> {
+  typedef Hash128 hash_type;
+
+  Hash128 hash(const std::string &k) {
+    return hash_bytes(k.data(), k.size());
+  }
+
+  bool key_equals(const std::string &a, const std::string &b) {
+    return a == b;
+  }
+};
+
+namespace hash_detail {
+
+template<class T>
+struct void_type {
+  typedef void type;
+};
+
+// Functor::stores_key if it is declared, and true otherwise.
+template<class Functor, class Enable = void>
+struct functor_stores_key {
+  static constexpr bool value = true;
+};
+
+template<class Functor>
+struct functor_stores_key<Functor,
+    typename void_type<decltype(Functor::stores_key)>::type> {
+  static constexpr bool value = Functor::stores_key;
+};
+
+}  // namespace hash_detail
+
+/**
+ * Describes how a hash map uses Functor: hash_type is the type positions are
+ * taken from and stores_key is whether keys are stored along with it.
+ */
+template<class Key, class Functor, class Enable = void>
+struct functor_traits {
+  typedef Key hash_type;
+  static constexpr bool stores_key = false;
+};
+
+template<class Key, class Functor>
+struct functor_traits<Key, Functor,
+    typename hash_detail::void_type<typename Functor::hash_type>::type> {
+  typedef typename Functor::hash_type hash_type;
+  static constexpr bool stores_key =
+      hash_detail::functor_stores_key<Functor>::value;
+};
+
+/**
+ * Holds a copy of the key in the nodes of hash maps whose functor has a
+ * hash_type, and nothing otherwise.
+ */
+template<class Key, bool Stored>
+class stored_key {
+ public:
+  explicit stored_key(const Key &k) : key_(k) {}
+  const Key &key() const { return key_; }
+
+ private:
+  Key key_;
+};
+
+template<class Key>
+class stored_key<Key, false> {
+ public:
+  explicit stored_key(const Key &) {}
+};
+
+/**
+ * A Functor which uses keys as their own hash, for keys which are already
+ * uniformly distributed.
+ */
+template<class Key, class Value>
+struct identity_functor {
+  Key hash(Key k) {
+    return k;
+  }
+  Key unhash(Key k) {
+    return k;
+  }
+
+  bool key_equals(Key a, Key b) {
+    return a == b;
+  }
+};
+
+}  // namespace wf
+}  // namespace containers
+}  // namespace tervel
+
+#endif  // TERVEL_CONTAINER_WF_HASH_MAP_HASH_TRAITS_H
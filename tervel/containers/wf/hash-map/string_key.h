@@ -0,0 +1,148 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_CONTAINER_WF_HASH_MAP_STRING_KEY_H
+#define TERVEL_CONTAINER_WF_HASH_MAP_STRING_KEY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <ostream>
+#include <string>
+
+#include <tervel/containers/wf/hash-map/hash_traits.h>
+
+namespace tervel {
+namespace containers {
+namespace wf {
+
+/**
+ * An immutable byte string key for the hash maps. Keys of up to INLINE_SIZE
+ * bytes are stored inline, so that they are in the same allocation as the
+ * hash map's data node, longer keys are copied to the heap.
+ */
+class StringKey {
+ public:
+  static constexpr size_t INLINE_SIZE = 24;
+
+  StringKey() : size_(0) {}
+
+  StringKey(const char *data, size_t size) {
+    init(data, size);
+  }
+
+  StringKey(const char *str) {  // NOLINT(runtime/explicit)
+    init(str, strlen(str));
+  }
+
+  StringKey(const std::string &str) {  // NOLINT(runtime/explicit)
+    init(str.data(), str.size());
+  }
+
+  StringKey(const StringKey &other) {
+    init(other.data(), other.size());
+  }
+
+  StringKey& operator=(const StringKey &other) {
+    if (this != &other) {
+      release();
+      init(other.data(), other.size());
+    }
+    return *this;
+  }
+
+  ~StringKey() {
+    release();
+  }
+
+  const char *data() const {
+    return is_inline() ? inline_ : heap_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  std::string str() const {
+    return std::string(data(), size());
+  }
+
+  bool operator==(const StringKey &other) const {
+    return size_ == other.size_ && memcmp(data(), other.data(), size_) == 0;
+  }
+  bool operator!=(const StringKey &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  bool is_inline() const {
+    return size_ <= INLINE_SIZE;
+  }
+
+  void init(const char *data, size_t size) {
+    size_ = size;
+    if (is_inline()) {
+      memcpy(inline_, data, size);
+    } else {
+      heap_ = new char[size];
+      memcpy(heap_, data, size);
+    }
+  }
+
+  void release() {
+    if (!is_inline()) {
+      delete [] heap_;
+    }
+    size_ = 0;
+  }
+
+  size_t size_;
+  union {
+    char inline_[INLINE_SIZE];
+    char *heap_;
+  };
+};
+
+inline std::ostream& operator<<(std::ostream &os, const StringKey &key) {
+  return os.write(key.data(), key.size());
+}
+
+template<class Value>
+struct default_functor<StringKey, Value> {
+  typedef Hash128 hash_type;
+
+  Hash128 hash(const StringKey &k) {
+    return hash_bytes(k.data(), k.size());
+  }
+
+  bool key_equals(const StringKey &a, const StringKey &b) {
+    return a == b;
+  }
+};
+
+}  // namespace wf
+}  // namespace containers
+}  // namespace tervel
+
+#endif  // TERVEL_CONTAINER_WF_HASH_MAP_STRING_KEY_H
@@ -25,11 +25,25 @@ THE SOFTWARE.
 #ifndef TERVEL_CONTAINER_WF_HASH_MAP_WFHM_HASHMAP_H
 #define TERVEL_CONTAINER_WF_HASH_MAP_WFHM_HASHMAP_H
 
+#include <algorithm>
 #include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <tervel/containers/wf/hash-map/hash_traits.h>
+#include <tervel/containers/wf/hash-map/string_key.h>
 #include <tervel/util/info.h>
 #include <tervel/util/memory/hp/hp_element.h>
 #include <tervel/util/memory/hp/hazard_pointer.h>
 #include <tervel/util/progress_assurance.h>
+#include <tervel/util/tagged_ptr.h>
 
 // TODO(Steven):
 //
@@ -43,22 +57,6 @@ THE SOFTWARE.
 namespace tervel {
 namespace containers {
 namespace wf {
-/**
- * A default Functor implementation
- *
- */
-template<class Key, class Value>
-struct default_functor {
-  Key hash(Key k) {
-    return k;
-  }
-
-  bool key_equals(Key a, Key b) {
-    return a == b;
-  }
-};
-
-
 
 /**
  * A wait-free hash map implementation.
@@ -67,20 +65,36 @@ struct default_functor {
  *
  * Functor should have the following functions:
  *   -Key hash(Key k) (where hash(a) == (hash(b) implies a == b
+ *       The default functor hashes keys with hash_traits<Key>.
  *   -bool key_equals (Key a, Key b)
  *       Important Note: the hashed value of keys will be passed in.
+ *   -Key unhash(Key h) (the inverse of hash, only required by for_each)
+ * or, for keys such as strings which cannot be hashed to a bijection, declare
+ * a hash_type, see functor_traits. std::string and StringKey keys use the
+ * latter by default.
  *
  */
 template< class Key, class Value, class Functor = default_functor<Key, Value> >
 class HashMap {
+  class DataNode;
+
  public:
   class ValueAccessor;
+  typedef functor_traits<Key, Functor> FunctorTraits;
+  // The type positions are taken from
+  typedef typename FunctorTraits::hash_type Hash;
+  static_assert(sizeof(Hash) % sizeof(uint64_t) == 0,
+      "Positions are taken from 64 bit words of the hash, use a Functor whose "
+      "hash_type is a multiple of 64 bits");
 
   HashMap(uint64_t capacity, uint64_t expansion_rate = 3)
-    : primary_array_size_(tervel::util::round_to_next_power_of_two(capacity))
+    : primary_array_size_(uint64_t(1) <<
+        tervel::util::round_to_next_power_of_two(
+            std::max<uint64_t>(capacity, 2)))
     , primary_array_pow_(std::log2(primary_array_size_))
     , secondary_array_size_(std::pow(2, expansion_rate))
     , secondary_array_pow_(expansion_rate)
+    , size_(0)
     , primary_array_(new Location[primary_array_size_]()) { }
 
   /**
@@ -96,7 +110,7 @@ class HashMap {
     for (size_t i = 0; i < primary_array_size_; i++) {
       Node * temp = primary_array_[i].load();
       if (temp != nullptr) {
-        delete temp;
+        delete slot_node(temp);
       }
     }
   }  // ~ HashMap
@@ -117,13 +131,34 @@ class HashMap {
    * @param va: the location to store the address of the value/access_counter
    * @return whether or not the key is present
    */
-  bool at(Key key, ValueAccessor &va);
+  bool at(const Key &key, ValueAccessor &va);
+
+  /**
+   * This function returns true and copies the associated value into value if
+   * the key exists in the hash map.
+   * Unlike at, the key's access counter is not modified; the copy is made
+   * while the data node is hazard pointer watched. This avoids contending on
+   * the counter of frequently read keys.
+   * Value must be trivially copyable. The copy is not synchronized with
+   * writes made through a ValueAccessor, so values of keys read with get
+   * must only be changed by replacing them, with insert_or_assign, update or
+   * compute, which never write to a data node that is in the hash map.
+   *
+   * The sequential complexity of this operation is O(max_depth()).
+   *
+   * @param key: the key to look up
+   * @param value: the location to copy the value to
+   * @return whether or not the key is present
+   */
+  bool get(const Key &key, Value *value);
 
   /**
    * This function returns true if the key value pair was successfully inserted.
    * Otherwise it returns false.
    *
-   * A key can fail to insert in the event the key is already present.
+   * A key can fail to insert in the event the key is already present, or
+   * when a different key with an equal hash is present, which can only occur
+   * if the functor declares a hash_type.
    *
    * The sequential complexity of this operation is O(max_depth()).
    *
@@ -131,17 +166,162 @@ class HashMap {
    * @param value: The key's associated value
    * @return whether or not the the key/value was inserted
    */
-  bool insert(Key key, Value value);
+  bool insert(const Key &key, Value value);
+
+  /**
+   * Inserts the key/value pairs (it->first, it->second) in [first, last).
+   * Each pair is inserted as if by insert, so the first of several pairs
+   * with equal keys is the one inserted.
+   *
+   * The pairs are hashed and partitioned by primary array position, then
+   * the subtree of each empty position is built privately and published
+   * with a single CAS. Positions which are not empty, or become non-empty during the load,
+   * fall back to insert. Hashing and building are split over num_threads
+   * threads, which do not need to be attached to the Tervel object. Intended
+   * for loading a new hash map.
+   *
+   * @param first, last: random access iterators over the pairs
+   * @param num_threads: the number of threads to hash and build with
+   * @return the number of keys inserted
+   */
+  template<class RandomIt>
+  size_t bulk_load(RandomIt first, RandomIt last, size_t num_threads = 1);
+
+  /**
+   * Inserts the key/value pairs (it->first, it->second) in [first, last),
+   * grouped by their position in the hash map so that consecutive inserts
+   * traverse the same, cached, array nodes.
+   *
+   * @param first, last: random access iterators over the pairs
+   * @return the number of keys inserted
+   */
+  template<class RandomIt>
+  size_t insert_batch(RandomIt first, RandomIt last);
+
+  /**
+   * Writes the key/value pairs to a snapshot file at path, which load can
+   * map back in. Other threads may operate on the hash map meanwhile: the
+   * pairs are gathered with for_each, so the snapshot is weakly consistent.
+   * Requires trivially copyable keys and values, which are written as is,
+   * so a snapshot is only readable on a machine with the same layout.
+   * The snapshot is written to path.tmp and renamed to path once it is
+   * complete, so a failed save leaves any previous snapshot at path intact.
+   *
+   * @param path: the file to write
+   * @return whether or not the file was written
+   */
+  bool save(const char *path);
+
+  /**
+   * Memory maps a snapshot written by save and inserts its pairs with
+   * bulk_load, so the image is read in place rather than parsed.
+   * Intended for loading a new hash map.
+   *
+   * @param path: the file to read
+   * @param num_threads: the number of threads to build with, see bulk_load
+   * @return whether or not the file was a valid snapshot for this hash map
+   */
+  bool load(const char *path, size_t num_threads = 1);
 
   /**
    * Attempts to remove a key/value pair from the hash map
    * Returns false in the event the key is not in the hash map or if the
    * access_counter is non-zero.
    *
+   * The sequential complexity of this operation is O(max_depth()).
+   *
    * @param key: The key to resume
    * @return where or not the key was removed
    */
-  bool remove(Key key);
+  bool remove(const Key &key);
+
+  /**
+   * Inserts the key with the passed value, or if the key is present replaces
+   * its data node with one holding the passed value. The old data node is
+   * freed once the last ValueAccessor referencing it is reset, so outstanding
+   * ValueAccessors continue to see the old value, and writes made through
+   * them after the replacement are lost. The old value is copied without
+   * synchronizing with such writes, so values changed through a
+   * ValueAccessor must not also be changed with insert_or_assign, update or
+   * compute.
+   *
+   * Returns false only when the key is absent and can not be inserted, see
+   * insert.
+   *
+   * The sequential complexity of this operation is O(max_depth()).
+   *
+   * @param key: The key to insert or assign
+   * @param value: The key's new value
+   * @param inserted: if not nullptr, set to whether the key was inserted
+   * @return whether or not the value was inserted or assigned
+   */
+  bool insert_or_assign(const Key &key, Value value, bool *inserted = nullptr);
+
+  /**
+   * Replaces the key's value with desired if it is currently equal to
+   * expected. As with insert_or_assign, the data node is replaced.
+   * Value must be trivially copyable. The comparison is made on a copy of the
+   * current value, which is torn if a ValueAccessor writes to it meanwhile,
+   * see insert_or_assign.
+   *
+   * @param key: The key to update
+   * @param expected: The value the key must currently have
+   * @param desired: The key's new value
+   * @return whether or not the key was present and held expected
+   */
+  bool update(const Key &key, Value expected, Value desired);
+
+  /**
+   * Replaces the key's value with func(current value), where func has the
+   * signature Value func(const Value &). If other updates of the key
+   * complete first, func is called again with the value they produced, so
+   * it should not have side effects.
+   * Value must be trivially copyable. func is applied to a copy of the
+   * current value, so as with update, the key's value must not also be
+   * changed through a ValueAccessor.
+   *
+   * @param key: The key to update
+   * @param func: The function producing the new value
+   * @param prev: if not nullptr, set to the value func was applied to
+   * @return whether or not the key was present
+   */
+  template<class Func>
+  bool compute(const Key &key, Func func, Value *prev = nullptr);
+
+  /**
+   * Adds delta to the key's value, for integral values.
+   * See compute.
+   *
+   * @param key: The key to update
+   * @param delta: The amount to add
+   * @param prev: if not nullptr, set to the value before the addition
+   * @return whether or not the key was present
+   */
+  bool fetch_add(const Key &key, Value delta, Value *prev = nullptr) {
+    static_assert(std::is_integral<Value>::value,
+        "fetch_add requires an integral value type, use compute");
+    return compute(key, [delta](const Value &v) { return v + delta; }, prev);
+  }
+
+  /**
+   * Calls fn(const Key &key, const Value &value) with a copy of each key and
+   * value pair in the hash map. The iteration is weakly consistent: each key
+   * present for the whole iteration is visited exactly once, keys inserted
+   * or removed during it may or may not be visited, and a key updated during
+   * it is visited with either value.
+   * fn is called without any hazard pointer watches held, so it may call
+   * operations on this hash map, such as removing the key.
+   *
+   * The primary array can be split into num_parts parts, each visited by a
+   * separate call, so that several attached threads can iterate over the
+   * hash map in parallel.
+   *
+   * @param fn: the function to call for each key and value
+   * @param part: the part to visit, in [0, num_parts)
+   * @param num_parts: the number of parts
+   */
+  template<class Func>
+  void for_each(Func fn, size_t part = 0, size_t num_parts = 1);
 
   /**
    * @return the number of keys in the hash map
@@ -150,17 +330,30 @@ class HashMap {
     return size_.load();
   };
 
+  /**
+   * Sets the progress assurance settings used by this hash map's operations.
+   * By default the settings of the Tervel object are used.
+   * Not Thread Safe! The settings must outlive the hash map.
+   *
+   * @param settings: the settings to use, nullptr for the Tervel object's
+   */
+  void set_progress_settings(tervel::util::ProgressSettings *settings) {
+    prog_settings_ = settings;
+  }
+
 
   /**
    * This class is used to safe guard access to values.
    * Before it is initialized the referenced data_node's access counter would
    * have been incremented.
+   * If the data_node was replaced by an update (e.g. insert_or_assign) while
+   * referenced, the last ValueAccessor to reset frees it.
    */
   class ValueAccessor {
    public:
     friend class HashMap;
     ValueAccessor()
-      : access_count_(nullptr)
+      : node_(nullptr)
       , value_(nullptr) {}
 
     ~ValueAccessor() {
@@ -178,7 +371,7 @@ class HashMap {
      * @return whether or not this was initialized.
      */
     bool valid() {
-      return (value_ != nullptr && access_count_ != nullptr);
+      return (value_ != nullptr && node_ != nullptr);
     }
 
     /**
@@ -186,9 +379,12 @@ class HashMap {
      * the variables.
      */
     void reset() {
-      if (access_count_) {
-        access_count_->fetch_add(-1);
-        access_count_ = nullptr;
+      if (node_) {
+        int64_t res = node_->access_count_.fetch_add(-1);
+        if (res == kReplaced + 1) {
+          reclaim_replaced(node_);
+        }
+        node_ = nullptr;
         value_ = nullptr;
       }
     }
@@ -196,29 +392,28 @@ class HashMap {
    private:
     /**
      * Initializes the value accessor.
-     * @param value: the address of the value
-     * @param access_count: the address of the value's access_count
+     * @param node: the data node whose access_count was incremented
      */
-    void init(Value * value, std::atomic<int64_t> *access_count) {
-      if (access_count_) {  // In case they reuse the object
+    void init(DataNode *node) {
+      if (node_) {  // In case they reuse the object
         reset();
       }
 
-      value_ = value;
-      access_count_ = access_count;
+      value_ = &(node->value_);
+      node_ = node;
     }
 
-    std::atomic<int64_t> *access_count_;
+    DataNode *node_;
     Value * value_;
   };
 
 
   /**
-   * @param key: The key
+   * @param hash: The hash of a key
    * @param depth: The depth
    * @return the position this key belongs in at the specified depth.
    */
-  uint64_t get_position(Key &key, size_t depth);
+  uint64_t get_position(const Hash &hash, size_t depth);
 
   /**
    * @return the maximum depth of the hash map, any depth beyond this would
@@ -230,7 +425,45 @@ class HashMap {
    * Outputs the positions a key belongs in at each depth.
    * @param key: The Key
    */
-  void print_key(Key &key);
+  void print_key(const Key &key);
+
+  /**
+   * Counts the keys stored at each depth, which shows how well the hash
+   * spreads keys over the primary array.
+   * Not Thread Safe!
+   *
+   * @param histogram: entry i receives the number of keys at depth i
+   */
+  void depth_histogram(std::vector<uint64_t> *histogram);
+
+  /**
+   * Occupancy and memory statistics, see stats.
+   */
+  struct Stats {
+    // The number of keys reached
+    uint64_t keys {0};
+    // The number of removed data nodes still held by a location, until an
+    // insert replaces them
+    uint64_t removed_nodes {0};
+    // The bytes of the primary array, array nodes and data nodes, excluding
+    // memory owned by keys and values and nodes awaiting reclamation
+    uint64_t bytes {0};
+    // Entry i is the number of array nodes at depth i
+    std::vector<uint64_t> array_nodes;
+    // Entry i is the number of keys at depth i
+    std::vector<uint64_t> data_nodes;
+  };
+
+  /**
+   * Computes occupancy and memory statistics by walking the hash map, so
+   * operations pay nothing for them. The walk is weakly consistent, as with
+   * for_each.
+   * Nodes removed or replaced but not yet reclaimed are counted for all
+   * structures by the hp_retired and hp_reclaimed tervel metrics.
+   *
+   * @param stats: receives the statistics
+   */
+  void stats(Stats *stats);
 
  private:
   class Node;
@@ -238,6 +471,155 @@ class HashMap {
   friend class ForceExpandOp;
   typedef std::atomic<Node *> Location;
 
+  /**
+   * Locations hold tagged node pointers: tag 0 marks ArrayNodes, and where
+   * the upper address bits are unused, tag 1 of a DataNode holds a
+   * fingerprint of its hash. This lets traversals branch on the node type and
+   * pass over data nodes of other keys without dereferencing them.
+   *
+   * Each entry is still a separately allocated DataNode, so a lookup which
+   * finds its key still dereferences that node. Storing keys and values
+   * inline in the array nodes would remove that miss and the allocation, but
+   * ValueAccessor and at() hand out references into the data node.
+   */
+#if TERVEL_ADDRESS_TAG_BITS >= 16
+  typedef tervel::util::TaggedPtr<Node, tervel::util::LowTag<1>,
+      tervel::util::HighTag<16>> Slot;
+#else
+  typedef tervel::util::TaggedPtr<Node, tervel::util::LowTag<1>> Slot;
+#endif
+
+  static Node *slot_node(Node *slot) {
+    return Slot::from_raw(reinterpret_cast<uintptr_t>(slot)).ptr();
+  }
+  static bool is_array_slot(Node *slot) {
+    return Slot::from_raw(reinterpret_cast<uintptr_t>(slot)).template tag<0>();
+  }
+  static Node *array_slot(Node *array_node) {
+    return reinterpret_cast<Node *>(
+        Slot(array_node).template with_tag<0>(1).raw());
+  }
+  static Node *data_slot(DataNode *data_node) {
+    return data_slot(data_node, data_node->hash_);
+  }
+  // For a data node which may not be dereferenced, hash must be its hash.
+  static Node *data_slot(DataNode *data_node, const Hash &hash) {
+#if TERVEL_ADDRESS_TAG_BITS >= 16
+    return reinterpret_cast<Node *>(Slot(data_node).template with_tag<1>(
+        fingerprint(hash)).raw());
+#else
+    (void)hash;
+    return data_node;
+#endif
+  }
+
+  /**
+   * @return false if slot holds a data node whose hash differs from hash.
+   */
+  static bool may_hold(Node *slot, const Hash &hash) {
+#if TERVEL_ADDRESS_TAG_BITS >= 16
+    return Slot::from_raw(reinterpret_cast<uintptr_t>(slot)).template tag<1>()
+        == (fingerprint(hash) & Slot::template Field<1>::mask);
+#else
+    return true;
+#endif
+  }
+
+  /**
+   * @return the last 64 bits of the hash, whose low bits are the last to be
+   * used as a position.
+   */
+  static uint64_t fingerprint(const Hash &hash) {
+    uint64_t res = 0;
+    const size_t len = std::min(sizeof(Hash), sizeof(res));
+    memcpy(&res, reinterpret_cast<const char *>(&hash) + sizeof(Hash) - len,
+        len);
+    return res;
+  }
+
+  /**
+   * The layout of a snapshot file: a header followed by count records.
+   */
+  struct SnapshotHeader {
+    uint64_t magic;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint64_t record_size;
+    uint64_t count;
+  };
+  struct SnapshotRecord {
+    Key first;
+    Value second;
+  };
+  static const uint64_t kSnapshotMagic = 0x314d48574c565254ULL;  // TRVLWHM1
+
+  /**
+   * A hashed key/value pair of a bulk_load or insert_batch, index is its
+   * offset from first.
+   */
+  struct BulkEntry {
+    Hash hash;
+    size_t index;
+  };
+
+  /**
+   * Orders entries by the positions their hashes select at each depth, and
+   * entries with equal hashes by index.
+   */
+  static bool bulk_less(const BulkEntry &a, const BulkEntry &b) {
+    const uint64_t *a_words = reinterpret_cast<const uint64_t *>(&a.hash);
+    const uint64_t *b_words = reinterpret_cast<const uint64_t *>(&b.hash);
+    for (size_t i = 0; i < sizeof(Hash) / sizeof(uint64_t); i++) {
+      if (a_words[i] != b_words[i]) {
+        return a_words[i] < b_words[i];
+      }
+    }
+    return a.index < b.index;
+  }
+
+  /**
+   * Hashes the pairs in [first, last) using num_threads threads, and
+   * partitions them by primary array position with a counting sort.
+   *
+   * @param entries: receives the entries, grouped by position
+   * @param offsets: receives where each position's entries begin, followed
+   * by the number of entries
+   */
+  template<class RandomIt>
+  void bulk_hash(RandomIt first, RandomIt last, size_t num_threads,
+      std::vector<BulkEntry> *entries, std::vector<size_t> *offsets);
+
+  /**
+   * Builds the subtree holding [begin, end), which are sorted with bulk_less
+   * and select the same positions up to depth. Not Thread Safe with respect to the returned
+   * subtree, which is not yet reachable.
+   *
+   * @param placed: incremented by the number of keys in the subtree
+   * @return the tagged word to store at depth
+   */
+  template<class RandomIt>
+  Node *bulk_build(RandomIt first, const BulkEntry *begin,
+      const BulkEntry *end, size_t depth, size_t *placed);
+
+  /**
+   * Calls fn for each key and value reachable from loc, see for_each.
+   */
+  template<class Func>
+  void for_each(Location *loc, Func &fn);
+
+  /**
+   * Adds the nodes reachable from loc, which is at the specified depth, to
+   * stats.
+   */
+  void stats(Location *loc, size_t depth, Stats *stats);
+
+  /**
+   * Adds the keys reachable from node, which is at the specified depth, to
+   * histogram.
+   */
+  void depth_histogram(Node *node, size_t depth,
+      std::vector<uint64_t> *histogram);
+
 
   /**
    * This class is used to differentiate between data_nodes and array_nodes/
@@ -259,26 +641,33 @@ class HashMap {
   };
 
   /**
-   * This class is used to hold the secondary array structure
+   * This class is used to hold the secondary array structure.
+   * The array is allocated inline, directly after the object, so reaching a
+   * position does not cost a second dependent load.
    */
   class ArrayNode : public Node {
    public:
-    explicit ArrayNode(uint64_t len)
-      : len_(len)
-      , internal_array_(new Location[len]()) {
-        for (size_t i = 0; i < len_; i++) {
-          internal_array_[i].store(nullptr);
-        }
-      }
+    /**
+     * @param len: The number of positions
+     * @return an ArrayNode whose positions are all nullptr
+     */
+    static ArrayNode *create(uint64_t len) {
+      void *mem = ::operator new(sizeof(ArrayNode) + len * sizeof(Location));
+      return new (mem) ArrayNode(len);
+    }
+
+    static void operator delete(void *mem) {
+      ::operator delete(mem);
+    }
 
     /**
      * See Notes on hash map destructor.
      */
     ~ArrayNode() {
       for (size_t i = 0; i < len_; i++) {
-        Node * temp = internal_array_[i].load();
+        Node * temp = internal_array()[i].load();
         if (temp != nullptr) {
-          delete temp;
+          delete slot_node(temp);
         }
       }
     }  // ~ArrayNode
@@ -290,7 +679,7 @@ class HashMap {
      */
     Location *access(uint64_t pos) {
       assert(pos < len_ && pos >=0);
-      return &(internal_array_[pos]);
+      return &(internal_array()[pos]);
     }
 
     /**
@@ -308,20 +697,33 @@ class HashMap {
     }
 
    private:
+    explicit ArrayNode(uint64_t len)
+      : len_(len) {
+        for (size_t i = 0; i < len_; i++) {
+          new (&(internal_array()[i])) Location(nullptr);
+        }
+      }
+
+    Location *internal_array() {
+      return reinterpret_cast<Location *>(this + 1);
+    }
+
     uint64_t len_;
-    std::unique_ptr<Location[]> internal_array_;
   };
 
   /**
    * This class is used to hold a key and value pair.
    * It is hazard pointer protected.
    */
-  class DataNode : public Node {
+  class DataNode : public Node,
+      public stored_key<Key, FunctorTraits::stores_key> {
    public:
-    explicit DataNode(Key k, Value v)
-      : key_(k)
+    DataNode(const Hash &h, const Key &k, Value v)
+      : stored_key<Key, FunctorTraits::stores_key>(k)
+      , hash_(h)
       , value_(v)
-      , access_count_(0) {}
+      , access_count_(0)
+      , replacement_(nullptr) {}
 
     ~DataNode() { }
 
@@ -339,14 +741,20 @@ class HashMap {
       return true;
     }
 
-    Key key_;
+    Hash hash_;
     Value value_;
     std::atomic<int64_t> access_count_;
+    // The data node that replaces this one, published by an update before it
+    // claims this node so that other threads can complete the replacement.
+    std::atomic<DataNode *> replacement_;
   };
 
 
   /**
-   * TODO(steven): add description
+   * Announced by an operation that was delayed at loc by other threads
+   * changing it. Helpers replace the data node (or nullptr) at loc with an
+   * array node, after which loc no longer changes, so each operation makes
+   * at most one announcement per depth.
    * TODO(steven): move into a file.
    */
   class ForceExpandOp : util::OpRecord {
@@ -364,10 +772,11 @@ class HashMap {
         while (true) {
           if (!map_->hp_watch_and_get_value(loc_,value)) {
              continue;
-          } else if (value == nullptr || value->is_data()) {
+          } else if (!is_array_slot(value)) {
             map_->expand_map(loc_, value, depth_);
-            value = loc_->load();
+            map_->hp_unwatch();
           } else {
+            map_->hp_unwatch();
             break;
           }
         }
@@ -392,7 +801,8 @@ class HashMap {
   /**
    * This is a wrapper for hazard pointers.
    * If it returns true then the value has been assigned the current value
-   * of loc and it is hazard pointer protected.
+   * of loc, a tagged word, and the node it references is hazard pointer
+   * protected.
    * @param  loc   the location to dereference a Node object from
    * @param  value the destination to write the Node objet pointer
    * @return       whether or not it was able to dereference and hazard pointer
@@ -401,6 +811,97 @@ class HashMap {
   bool hp_watch_and_get_value(Location * loc, Node * &value);
   void hp_unwatch();
 
+  /**
+   * A data node's access_count_ has kReplacing added once its replacement_
+   * is claimed, which excludes removes, and kUnlinked added once the
+   * replacement is in its location. It is freed when no ValueAccessors
+   * remain, that is when its access_count_ reaches kReplaced, after which it
+   * is set to kReclaimed. Removed data nodes are instead set to -num_threads,
+   * so the two remain distinguishable while lookups briefly increment them.
+   */
+  static const int64_t kReplacing = int64_t(1) << 60;
+  static const int64_t kUnlinked = int64_t(1) << 61;
+  static const int64_t kReplaced = kReplacing + kUnlinked;
+  static const int64_t kReclaimed = -kReplaced;
+
+  /**
+   * Frees a replaced data node whose access_count_ was observed at kReplaced,
+   * unless a concurrent lookup incremented it in the meantime.
+   */
+  static void reclaim_replaced(DataNode *data_node) {
+    int64_t expected = kReplaced;
+    if (data_node->access_count_.compare_exchange_strong(expected,
+          kReclaimed)) {
+      data_node->safe_delete();
+    }
+  }
+
+  /**
+   * Claims data_node for the replacement published in its replacement_,
+   * unless it was removed first, and places the replacement in data_node's
+   * location, which is loc or a location below it. Any thread which finds
+   * a published replacement completes it, so a delayed update does not
+   * delay others. data_node must be hazard pointer watched.
+   *
+   * @param loc: the location data_node was found at
+   * @param data_node: the data node being replaced
+   * @param depth: the depth of loc
+   * @return whether or not the replacement was claimed, in which case it has
+   * been placed
+   */
+  bool complete_replacement(Location *loc, DataNode *data_node, size_t depth);
+
+  /**
+   * Shared implementation of insert_or_assign, update and compute.
+   * Locates the key's data node and, once it is claimed, replaces it with a
+   * data node holding the value produced by func, which has the signature
+   * bool func(const Value &current, Value *desired) and may decline the
+   * replacement by returning false.
+   *
+   * @param insert_value: if not nullptr, the value to insert if the key is
+   * absent
+   * @param prev: if not nullptr, set to the value passed to func
+   * @param inserted: if not nullptr, set to whether the key was inserted
+   * @return whether or not the key was inserted or its value replaced
+   */
+  template<class Func>
+  bool replace_value(const Key &key, Func func, const Value *insert_value,
+      Value *prev, bool *inserted);
+
+  /**
+   * @return the key held by data_node, which is stored or recovered from its
+   * hash.
+   */
+  Key node_key(DataNode *data_node) {
+    return node_key(data_node,
+        std::integral_constant<bool, FunctorTraits::stores_key>());
+  }
+  Key node_key(DataNode *data_node, std::false_type) {
+    Functor functor;
+    return functor.unhash(data_node->hash_);
+  }
+  Key node_key(DataNode *data_node, std::true_type) {
+    return data_node->key();
+  }
+
+  /**
+   * @return whether data_node holds key, whose hash is hash.
+   */
+  bool key_matches(DataNode *data_node, const Hash &hash, const Key &key) {
+    return key_matches(data_node, hash, key,
+        std::integral_constant<bool, FunctorTraits::stores_key>());
+  }
+  bool key_matches(DataNode *data_node, const Hash &hash, const Key &,
+        std::false_type) {
+    Functor functor;
+    return functor.key_equals(data_node->hash_, hash);
+  }
+  bool key_matches(DataNode *data_node, const Hash &hash, const Key &key,
+        std::true_type) {
+    Functor functor;
+    return data_node->hash_ == hash && functor.key_equals(data_node->key(), key);
+  }
+
   const size_t primary_array_size_;
   const size_t primary_array_pow_;
   const size_t secondary_array_size_;
@@ -409,6 +910,9 @@ class HashMap {
   std::atomic<uint64_t> size_;
 
   std::unique_ptr<Location[]> primary_array_;
+
+  // Progress assurance settings, nullptr to use the Tervel object's
+  tervel::util::ProgressSettings *prog_settings_ {nullptr};
 };  // class wf hash map
 
 
@@ -432,14 +936,16 @@ hp_watch_and_get_value(Location * loc, Node * &value) {
     return true;
   }
 
+  // The node is watched, while the tagged word is what loc must still hold.
+  void * node = slot_node(reinterpret_cast<Node *>(temp));
   bool is_watched = tervel::util::memory::hp::HazardPointer::watch(
         tervel::util::memory::hp::HazardPointer::SlotID::SHORTUSE,
-        temp, temp_address, temp);
+        node, temp_address, temp);
 
   if (is_watched) {
     value = reinterpret_cast<Node *>(temp);
 
-    assert(tervel::util::memory::hp::HazardPointer::is_watched(temp) == true);
+    assert(tervel::util::memory::hp::HazardPointer::is_watched(node) == true);
   }
 
   return is_watched;
@@ -455,26 +961,30 @@ hp_unwatch() {
 
 template<class Key, class Value, class Functor>
 bool HashMap<Key, Value, Functor>::
-at(Key key, ValueAccessor &va) {
+at(const Key &key, ValueAccessor &va) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(at)
+  #endif
   assert(hp_check_empty() && " Error: Function Did not release hp watch ");
   Functor functor;
-  key = functor.hash(key);
+  Hash hash = functor.hash(key);
 
   size_t depth = 0;
-  uint64_t position = get_position(key, depth);
+  uint64_t position = get_position(hash, depth);
   Location *loc = &(primary_array_[position]);
   Node *curr_value;
 
 
   bool op_res = false;
 
-  tervel::util::ProgressAssurance::Limit progAssur;
+  tervel::util::ProgressAssurance::Limit progAssur(prog_settings_);
   while (true) {
     if (progAssur.isDelayed(0)) {
       ForceExpandOp *op = new ForceExpandOp(this, loc, depth);
       util::ProgressAssurance::make_announcement(
-            reinterpret_cast<tervel::util::OpRecord *>(op));
-      progAssur.reset();
+            reinterpret_cast<tervel::util::OpRecord *>(op), prog_settings_);
+      op->safe_delete();
+      progAssur.reset(prog_settings_);
       continue;
     }
 
@@ -483,24 +993,30 @@ at(Key key, ValueAccessor &va) {
       continue;
     } else if (curr_value == nullptr) {
       break;
-    } else if (curr_value->is_array()) {
-      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(curr_value);
+    } else if (is_array_slot(curr_value)) {
+      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(slot_node(curr_value));
       depth++;
-      position = get_position(key, depth);
+      position = get_position(hash, depth);
       loc = array_node->access(position);
       hp_unwatch();
       continue;
     } else {
-      assert(curr_value->is_data());
-      DataNode * data_node = reinterpret_cast<DataNode *>(curr_value);
+      assert(slot_node(curr_value)->is_data());
+      DataNode * data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
 
-      if (functor.key_equals(data_node->key_, key)) {
+      if (may_hold(curr_value, hash) && key_matches(data_node, hash, key)) {
         int64_t res = data_node->access_count_.fetch_add(1);
         if (res >= 0) {  // its not deleted.
-          va.init(&(data_node->value_), &(data_node->access_count_));
+          va.init(data_node);
           op_res = true;
         } else {
           data_node->access_count_.fetch_add(-1);
+          if (loc->load() != curr_value) {
+            // It was replaced by an update, look at its replacement.
+            hp_unwatch();
+            progAssur.isDelayed(1);
+            continue;
+          }
           op_res = false;
         }
       }
@@ -517,19 +1033,92 @@ at(Key key, ValueAccessor &va) {
 
 template<class Key, class Value, class Functor>
 bool HashMap<Key, Value, Functor>::
-insert(Key key, Value value) {
+get(const Key &key, Value *value) {
+  static_assert(std::is_trivially_copyable<Value>::value,
+      "get copies the value, use at for values which are not trivially "
+      "copyable");
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(at)
+  #endif
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  Functor functor;
+  Hash hash = functor.hash(key);
+
+  size_t depth = 0;
+  uint64_t position = get_position(hash, depth);
+  Location *loc = &(primary_array_[position]);
+  Node *curr_value;
+
+  bool op_res = false;
+
+  tervel::util::ProgressAssurance::Limit progAssur(prog_settings_);
+  while (true) {
+    if (progAssur.isDelayed(0)) {
+      ForceExpandOp *op = new ForceExpandOp(this, loc, depth);
+      util::ProgressAssurance::make_announcement(
+            reinterpret_cast<tervel::util::OpRecord *>(op), prog_settings_);
+      op->safe_delete();
+      progAssur.reset(prog_settings_);
+      continue;
+    }
+
+    if (!hp_watch_and_get_value(loc, curr_value)) {
+      progAssur.isDelayed(1);
+      continue;
+    } else if (curr_value == nullptr) {
+      break;
+    } else if (is_array_slot(curr_value)) {
+      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(slot_node(curr_value));
+      depth++;
+      position = get_position(hash, depth);
+      loc = array_node->access(position);
+      hp_unwatch();
+      continue;
+    } else {
+      assert(slot_node(curr_value)->is_data());
+      DataNode * data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
+
+      if (may_hold(curr_value, hash) && key_matches(data_node, hash, key)) {
+        if (data_node->access_count_.load() >= 0) {  // its not deleted.
+          *value = data_node->value_;
+          op_res = true;
+        } else if (loc->load() != curr_value) {
+          // It was replaced by an update, look at its replacement.
+          hp_unwatch();
+          progAssur.isDelayed(1);
+          continue;
+        }
+      }
+      hp_unwatch();
+      break;
+    }
+    assert(false);
+  }  // while true
+
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  return op_res;
+}  // get
+
+
+template<class Key, class Value, class Functor>
+bool HashMap<Key, Value, Functor>::
+insert(const Key &key, Value value) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(insert)
+  #endif
   assert(hp_check_empty() && " Error: Function Did not release hp watch ");
-  tervel::util::ProgressAssurance::check_for_announcement();
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr,
+      prog_settings_);
 
   Functor functor;
-  key = functor.hash(key);
+  Hash hash = functor.hash(key);
 
-  DataNode * new_node = new DataNode(key, value);
+  DataNode * new_node = new DataNode(hash, key, value);
 
-  tervel::util::ProgressAssurance::Limit progAssur;
+  tervel::util::ProgressAssurance::Limit progAssur(prog_settings_);
 
   size_t depth = 0;
-  uint64_t position = get_position(key, depth);
+  uint64_t position = get_position(hash, depth);
   Location *loc = &(primary_array_[position]);
   Node *curr_value;
 
@@ -538,8 +1127,9 @@ insert(Key key, Value value) {
     if (progAssur.isDelayed(0)) {
       ForceExpandOp *op = new ForceExpandOp(this, loc, depth);
       util::ProgressAssurance::make_announcement(
-            reinterpret_cast<tervel::util::OpRecord *>(op));
-      progAssur.reset();
+            reinterpret_cast<tervel::util::OpRecord *>(op), prog_settings_);
+      op->safe_delete();
+      progAssur.reset(prog_settings_);
       continue;
     }
 
@@ -549,7 +1139,7 @@ insert(Key key, Value value) {
     }
 
     if (curr_value == nullptr) {
-      if (loc->compare_exchange_strong(curr_value, new_node)) {
+      if (loc->compare_exchange_strong(curr_value, data_slot(new_node))) {
         size_.fetch_add(1);
         op_res = true;
         break;
@@ -557,19 +1147,19 @@ insert(Key key, Value value) {
         progAssur.isDelayed(1);
         continue;
       }
-    } else if (curr_value->is_array()) {
-      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(curr_value);
+    } else if (is_array_slot(curr_value)) {
+      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(slot_node(curr_value));
       depth++;
-      position = get_position(key, depth);
+      position = get_position(hash, depth);
       loc = array_node->access(position);
       hp_unwatch();
       continue;
     } else {  // it is a data node
-      assert(curr_value->is_data());
-      DataNode * data_node = reinterpret_cast<DataNode *>(curr_value);
+      assert(slot_node(curr_value)->is_data());
+      DataNode * data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
 
       if (data_node->access_count_.load() < 0) {
-        if (loc->compare_exchange_strong(curr_value, new_node)) {
+        if (loc->compare_exchange_strong(curr_value, data_slot(new_node))) {
           hp_unwatch();
           data_node->safe_delete();
           size_.fetch_add(1);
@@ -580,7 +1170,12 @@ insert(Key key, Value value) {
           progAssur.isDelayed(1);
           continue;
         }
-      } else if (functor.key_equals(data_node->key_, key)) {
+      } else if (key_matches(data_node, hash, key)) {
+        op_res = false;
+        hp_unwatch();
+        break;
+      } else if (depth >= max_depth()) {
+        // A different key with an equal hash, they can not be separated.
         op_res = false;
         hp_unwatch();
         break;
@@ -595,7 +1190,7 @@ insert(Key key, Value value) {
   }  // while true
 
   if (!op_res) {
-    assert(loc->load() != new_node);
+    assert(loc->load() != data_slot(new_node));
     delete new_node;
   }
 
@@ -604,25 +1199,308 @@ insert(Key key, Value value) {
 }  // insert
 
 
+template<class Key, class Value, class Functor>
+template<class RandomIt>
+size_t HashMap<Key, Value, Functor>::
+bulk_load(RandomIt first, RandomIt last, size_t num_threads) {
+  std::vector<BulkEntry> entries;
+  std::vector<size_t> offsets;
+  bulk_hash(first, last, num_threads, &entries, &offsets);
+
+  // Positions whose subtree could not be published, which are inserted into
+  // by the calling thread.
+  std::vector<char> failed(primary_array_size_, 0);
+  std::vector<size_t> placed(std::max<size_t>(num_threads, 1), 0);
+
+  auto build = [&](size_t part) {
+    const size_t begin = primary_array_size_ * part / placed.size();
+    const size_t end = primary_array_size_ * (part + 1) / placed.size();
+    for (size_t i = begin; i < end; i++) {
+      if (offsets[i] == offsets[i + 1]) {
+        continue;
+      } else if (primary_array_[i].load() != nullptr) {
+        failed[i] = 1;
+        continue;
+      }
+
+      std::sort(entries.begin() + offsets[i], entries.begin() + offsets[i + 1],
+          bulk_less);
+      size_t subtree_size = 0;
+      Node *subtree = bulk_build(first, &(entries[offsets[i]]),
+          &(entries[offsets[i + 1]]), 0, &subtree_size);
+      Node *expected = nullptr;
+      if (primary_array_[i].compare_exchange_strong(expected, subtree)) {
+        placed[part] += subtree_size;
+      } else {
+        delete slot_node(subtree);
+        failed[i] = 1;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < placed.size(); i++) {
+    threads.emplace_back(build, i);
+  }
+  build(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  size_t res = 0;
+  for (size_t count : placed) {
+    res += count;
+  }
+  size_.fetch_add(res);
+
+  for (size_t i = 0; i < primary_array_size_; i++) {
+    if (!failed[i]) {
+      continue;
+    }
+    std::sort(entries.begin() + offsets[i], entries.begin() + offsets[i + 1],
+        [](const BulkEntry &a, const BulkEntry &b) {
+          return a.index < b.index;
+        });
+    for (size_t j = offsets[i]; j < offsets[i + 1]; j++) {
+      if (insert(first[entries[j].index].first,
+            first[entries[j].index].second)) {
+        res++;
+      }
+    }
+  }
+  return res;
+}  // bulk_load
+
+
+template<class Key, class Value, class Functor>
+template<class RandomIt>
+size_t HashMap<Key, Value, Functor>::
+insert_batch(RandomIt first, RandomIt last) {
+  std::vector<BulkEntry> entries;
+  std::vector<size_t> offsets;
+  bulk_hash(first, last, 1, &entries, &offsets);
+
+  size_t res = 0;
+  for (const BulkEntry &entry : entries) {
+    if (insert(first[entry.index].first, first[entry.index].second)) {
+      res++;
+    }
+  }
+  return res;
+}  // insert_batch
+
+
 template<class Key, class Value, class Functor>
 bool HashMap<Key, Value, Functor>::
-remove(Key key) {
+save(const char *path) {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+      std::is_trivially_copyable<Value>::value,
+      "Snapshots require trivially copyable keys and values");
+  // A failed save must not leave a torn snapshot at path, so the snapshot is
+  // written to a temporary file which replaces path once it is complete.
+  const std::string temp_path = std::string(path) + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kSnapshotMagic;
+  header.key_size = sizeof(Key);
+  header.value_size = sizeof(Value);
+  header.record_size = sizeof(SnapshotRecord);
+  bool res = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  // Records are written in primary array order, which bulk_load partitions
+  // by with sequential writes.
+  for_each([&](const Key &key, const Value &value) {
+    SnapshotRecord record;
+    memset(&record, 0, sizeof(record));  // So padding is not left undefined
+    record.first = key;
+    record.second = value;
+    res = res && fwrite(&record, sizeof(record), 1, file) == 1;
+    header.count++;
+  });
+
+  // The count is only known after the traversal.
+  res = res && fseek(file, 0, SEEK_SET) == 0 &&
+      fwrite(&header, sizeof(header), 1, file) == 1;
+  res = res && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  res = (fclose(file) == 0) && res;
+  if (!res) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return rename(temp_path.c_str(), path) == 0;
+}  // save
+
+
+template<class Key, class Value, class Functor>
+bool HashMap<Key, Value, Functor>::
+load(const char *path, size_t num_threads) {
+  static_assert(std::is_trivially_copyable<Key>::value &&
+      std::is_trivially_copyable<Value>::value,
+      "Snapshots require trivially copyable keys and values");
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(SnapshotHeader)) {
+    close(fd);
+    return false;
+  }
+
+  const size_t len = file_stat.st_size;
+  void *image = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    return false;
+  }
+
+  const SnapshotHeader *header =
+      reinterpret_cast<const SnapshotHeader *>(image);
+  bool res = header->magic == kSnapshotMagic &&
+      header->key_size == sizeof(Key) &&
+      header->value_size == sizeof(Value) &&
+      header->record_size == sizeof(SnapshotRecord) &&
+      (len - sizeof(SnapshotHeader)) % sizeof(SnapshotRecord) == 0 &&
+      header->count == (len - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord);
+  if (res) {
+    madvise(image, len, MADV_SEQUENTIAL);
+    const SnapshotRecord *records = reinterpret_cast<const SnapshotRecord *>(
+        reinterpret_cast<const char *>(image) + sizeof(SnapshotHeader));
+    bulk_load(records, records + header->count, num_threads);
+  }
+
+  munmap(image, len);
+  return res;
+}  // load
+
+
+template<class Key, class Value, class Functor>
+template<class RandomIt>
+void HashMap<Key, Value, Functor>::
+bulk_hash(RandomIt first, RandomIt last, size_t num_threads,
+    std::vector<BulkEntry> *entries, std::vector<size_t> *offsets) {
+  const size_t len = last - first;
+  num_threads = std::max<size_t>(std::min(num_threads, len), 1);
+
+  std::vector<BulkEntry> hashed(len);
+  assert(primary_array_size_ <= UINT32_MAX);
+  std::vector<uint32_t> positions(len);
+  std::vector<std::vector<size_t>> counts(num_threads,
+      std::vector<size_t>(primary_array_size_, 0));
+
+  auto hash = [&](size_t part) {
+    Functor functor;
+    const size_t begin = len * part / num_threads;
+    const size_t end = len * (part + 1) / num_threads;
+    for (size_t i = begin; i < end; i++) {
+      hashed[i].hash = functor.hash(first[i].first);
+      hashed[i].index = i;
+      positions[i] = get_position(hashed[i].hash, 0);
+      counts[part][positions[i]]++;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(hash, i);
+  }
+  hash(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Each part scatters its entries after those of earlier parts, so the
+  // entries of a position stay in index order.
+  offsets->assign(primary_array_size_ + 1, 0);
+  size_t total = 0;
+  for (size_t i = 0; i < primary_array_size_; i++) {
+    (*offsets)[i] = total;
+    for (size_t part = 0; part < num_threads; part++) {
+      size_t count = counts[part][i];
+      counts[part][i] = total;
+      total += count;
+    }
+  }
+  (*offsets)[primary_array_size_] = total;
+
+  entries->resize(len);
+  for (size_t part = 0; part < num_threads; part++) {
+    const size_t begin = len * part / num_threads;
+    const size_t end = len * (part + 1) / num_threads;
+    for (size_t i = begin; i < end; i++) {
+      (*entries)[counts[part][positions[i]]++] = hashed[i];
+    }
+  }
+}  // bulk_hash
+
+
+template<class Key, class Value, class Functor>
+template<class RandomIt>
+typename HashMap<Key, Value, Functor>::Node *
+HashMap<Key, Value, Functor>::
+bulk_build(RandomIt first, const BulkEntry *begin, const BulkEntry *end,
+    size_t depth, size_t *placed) {
+  assert(begin < end);
+  if (begin->hash == (end - 1)->hash) {
+    // A single key, or keys with equal hashes of which, as with insert, only
+    // the first is inserted.
+    const auto &pair = first[begin->index];
+    (*placed)++;
+    return data_slot(new DataNode(begin->hash, pair.first, pair.second));
+  }
+  assert(depth < max_depth());
+
+  ArrayNode *array_node = ArrayNode::create(secondary_array_size_);
+  while (begin < end) {
+    const uint64_t position = get_position(begin->hash, depth + 1);
+    const BulkEntry *run_end = begin + 1;
+    while (run_end < end && get_position(run_end->hash, depth + 1) == position) {
+      run_end++;
+    }
+    array_node->access(position)->store(
+        bulk_build(first, begin, run_end, depth + 1, placed));
+    begin = run_end;
+  }
+  return array_slot(array_node);
+}  // bulk_build
+
+
+template<class Key, class Value, class Functor>
+bool HashMap<Key, Value, Functor>::
+remove(const Key &key) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(remove)
+  #endif
   assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr,
+      prog_settings_);
+
   Functor functor;
-  key = functor.hash(key);
+  Hash hash = functor.hash(key);
 
   size_t depth = 0;
-  uint64_t position = get_position(key, depth);
+  uint64_t position = get_position(hash, depth);
 
   Location *loc = &(primary_array_[position]);
 
-  tervel::util::ProgressAssurance::Limit progAssur;
+  tervel::util::ProgressAssurance::Limit progAssur(prog_settings_);
 
   bool op_res = false;
   while (true) {
     if (progAssur.isDelayed(0)) {
-      //TODO add operation record.
-      progAssur.reset();
+      // Only changes to loc can delay a remove, so once loc is forced into an
+      // array node the remove continues at the next depth.
+      ForceExpandOp *op = new ForceExpandOp(this, loc, depth);
+      util::ProgressAssurance::make_announcement(
+            reinterpret_cast<tervel::util::OpRecord *>(op), prog_settings_);
+      op->safe_delete();
+      progAssur.reset(prog_settings_);
       continue;
     }
 
@@ -634,18 +1512,18 @@ remove(Key key) {
     if (curr_value == nullptr) {
       op_res = false;
       break;
-    } else if (curr_value->is_array()) {
-      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(curr_value);
+    } else if (is_array_slot(curr_value)) {
+      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(slot_node(curr_value));
       depth++;
-      position = get_position(key, depth);
+      position = get_position(hash, depth);
       loc = array_node->access(position);
       hp_unwatch();
       continue;
     } else {  // it is a data node
-      assert(curr_value->is_data());
-      DataNode *data_node = reinterpret_cast<DataNode *>(curr_value);
+      assert(slot_node(curr_value)->is_data());
+      DataNode *data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
       int64_t temp_expected = 0;
-      if (functor.key_equals(data_node->key_, key) &&
+      if (may_hold(curr_value, hash) && key_matches(data_node, hash, key) &&
           data_node->access_count_.compare_exchange_strong(temp_expected,
                   -1*tl_thread_info->get_num_threads())
                                                       ) {
@@ -662,6 +1540,13 @@ remove(Key key) {
           // It is logically deleted, and some other thread will/has already removed and freed it
         }
 
+      } else if (temp_expected >= kReplacing) {
+        // It is being replaced by an update, complete the replacement and
+        // remove that instead.
+        complete_replacement(loc, data_node, depth);
+        hp_unwatch();
+        progAssur.isDelayed(1);
+        continue;
       }
       hp_unwatch();
       break;
@@ -675,25 +1560,265 @@ remove(Key key) {
 }  // remove
 
 
+template<class Key, class Value, class Functor>
+bool HashMap<Key, Value, Functor>::
+insert_or_assign(const Key &key, Value value, bool *inserted) {
+  return replace_value(key, [&value](const Value &, Value *desired) {
+      *desired = value;
+      return true;
+    }, &value, nullptr, inserted);
+}  // insert_or_assign
+
+
+template<class Key, class Value, class Functor>
+bool HashMap<Key, Value, Functor>::
+update(const Key &key, Value expected, Value desired) {
+  static_assert(std::is_trivially_copyable<Value>::value,
+      "update copies the current value, use a ValueAccessor for values which "
+      "are not trivially copyable");
+  return replace_value(key, [&expected, &desired](const Value &current,
+        Value *res) {
+      if (!(current == expected)) {
+        return false;
+      }
+      *res = desired;
+      return true;
+    }, nullptr, nullptr, nullptr);
+}  // update
+
+
+template<class Key, class Value, class Functor>
+template<class Func>
+bool HashMap<Key, Value, Functor>::
+compute(const Key &key, Func func, Value *prev) {
+  static_assert(std::is_trivially_copyable<Value>::value,
+      "compute copies the current value, use a ValueAccessor for values "
+      "which are not trivially copyable");
+  return replace_value(key, [&func](const Value &current, Value *desired) {
+      *desired = func(current);
+      return true;
+    }, nullptr, prev, nullptr);
+}  // compute
+
+
+template<class Key, class Value, class Functor>
+template<class Func>
+bool HashMap<Key, Value, Functor>::
+replace_value(const Key &key, Func func, const Value *insert_value,
+    Value *prev, bool *inserted) {
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr,
+      prog_settings_);
+
+  Functor functor;
+  Hash hash = functor.hash(key);
+
+  // Allocated on first use, it holds either the inserted or the new value.
+  DataNode *new_node = nullptr;
+
+  tervel::util::ProgressAssurance::Limit progAssur(prog_settings_);
+
+  size_t depth = 0;
+  uint64_t position = get_position(hash, depth);
+  Location *loc = &(primary_array_[position]);
+  Node *curr_value;
+
+  bool op_res = false;
+  bool op_inserted = false;
+  while (true) {
+    if (progAssur.isDelayed(0)) {
+      ForceExpandOp *op = new ForceExpandOp(this, loc, depth);
+      util::ProgressAssurance::make_announcement(
+            reinterpret_cast<tervel::util::OpRecord *>(op), prog_settings_);
+      op->safe_delete();
+      progAssur.reset(prog_settings_);
+      continue;
+    }
+
+    if (!hp_watch_and_get_value(loc, curr_value)) {
+      progAssur.isDelayed(1);
+      continue;
+    }
+
+    if (curr_value == nullptr) {
+      if (insert_value == nullptr) {
+        break;
+      } else if (new_node == nullptr) {
+        new_node = new DataNode(hash, key, *insert_value);
+      } else {
+        new_node->value_ = *insert_value;
+      }
+
+      if (loc->compare_exchange_strong(curr_value, data_slot(new_node))) {
+        size_.fetch_add(1);
+        op_res = op_inserted = true;
+        break;
+      } else {
+        progAssur.isDelayed(1);
+        continue;
+      }
+    } else if (is_array_slot(curr_value)) {
+      ArrayNode * array_node = reinterpret_cast<ArrayNode *>(slot_node(curr_value));
+      depth++;
+      position = get_position(hash, depth);
+      loc = array_node->access(position);
+      hp_unwatch();
+      continue;
+    }
+
+    if (insert_value == nullptr && !may_hold(curr_value, hash)) {
+      hp_unwatch();
+      break;
+    }
+
+    assert(slot_node(curr_value)->is_data());
+    DataNode * data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
+    int64_t access_count = data_node->access_count_.load();
+
+    if (access_count < 0) {
+      if (insert_value == nullptr) {
+        hp_unwatch();
+        break;
+      } else if (new_node == nullptr) {
+        new_node = new DataNode(hash, key, *insert_value);
+      } else {
+        new_node->value_ = *insert_value;
+      }
+
+      if (loc->compare_exchange_strong(curr_value, data_slot(new_node))) {
+        hp_unwatch();
+        data_node->safe_delete();
+        size_.fetch_add(1);
+        op_res = op_inserted = true;
+        break;
+      } else {
+        hp_unwatch();
+        progAssur.isDelayed(1);
+        continue;
+      }
+    } else if (!key_matches(data_node, hash, key)) {
+      if (insert_value == nullptr || depth >= max_depth()) {
+        hp_unwatch();
+        break;
+      }
+      // Key differs, needs to expand...
+      expand_map(loc, curr_value, depth);
+      hp_unwatch();
+      continue;
+    }
+
+    DataNode *replacement = data_node->replacement_.load();
+    Value current = data_node->value_;
+    if (replacement == nullptr) {
+      Value desired;
+      if (!func(current, &desired)) {
+        hp_unwatch();
+        break;
+      }
+
+      if (new_node == nullptr) {
+        new_node = new DataNode(hash, key, desired);
+      } else {
+        new_node->value_ = desired;
+      }
+      if (data_node->replacement_.compare_exchange_strong(replacement,
+            new_node)) {
+        replacement = new_node;
+      }
+    }
+
+    // Whether it is ours or another update's, the published replacement is
+    // completed before continuing.
+    bool replaced = complete_replacement(loc, data_node, depth);
+    hp_unwatch();
+    if (replaced && replacement == new_node) {
+      if (prev != nullptr) {
+        *prev = current;
+      }
+      op_res = true;
+      break;
+    }
+    // Either another update replaced the node, or it was removed before the
+    // replacement was claimed.
+    progAssur.isDelayed(1);
+    continue;
+  }  // while true
+
+  if (new_node != nullptr && !op_res) {
+    assert(loc->load() != data_slot(new_node));
+    delete new_node;
+  }
+  if (inserted != nullptr) {
+    *inserted = op_inserted;
+  }
+
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  return op_res;
+}  // replace_value
+
+
+template<class Key, class Value, class Functor>
+bool HashMap<Key, Value, Functor>::
+complete_replacement(Location *loc, DataNode *data_node, size_t depth) {
+  DataNode *replacement = data_node->replacement_.load();
+  assert(replacement != nullptr);
+
+  int64_t access_count = data_node->access_count_.load();
+  while (access_count >= 0 && access_count < kReplacing) {
+    data_node->access_count_.compare_exchange_strong(access_count,
+        access_count + kReplacing);
+  }
+  if (access_count < 0) {
+    // Either removed before being claimed (near -num_threads), or already
+    // replaced and reclaimed (near kReclaimed).
+    return access_count < -kReplacing;
+  } else if (access_count >= kUnlinked) {
+    return true;
+  }
+
+  // The replacement is not watched, it may already have been placed and
+  // freed, so its slot is formed from data_node's hash, which it shares.
+  Node *desired = data_slot(replacement, data_node->hash_);
+
+  // data_node only leaves its location once the replacement is placed, and
+  // otherwise only moves down into array nodes.
+  Node *expected = data_slot(data_node);
+  while (!loc->compare_exchange_strong(expected, desired)) {
+    if (!is_array_slot(expected)) {
+      return true;
+    }
+    ArrayNode *array_node = reinterpret_cast<ArrayNode *>(slot_node(expected));
+    depth++;
+    loc = array_node->access(get_position(data_node->hash_, depth));
+    expected = data_slot(data_node);
+  }
+
+  if (data_node->access_count_.fetch_add(kUnlinked) == kReplacing) {
+    reclaim_replaced(data_node);
+  }
+  return true;
+}  // complete_replacement
+
+
 template<class Key, class Value, class Functor>
 void  HashMap<Key, Value, Functor>::
 expand_map(Location * loc, Node * curr_value, size_t depth) {
 
   uint64_t next_position = 0;
 
-  ArrayNode * array_node = new ArrayNode(secondary_array_size_);
+  ArrayNode * array_node = ArrayNode::create(secondary_array_size_);
   if (curr_value != nullptr) {
-    assert(curr_value->is_data());
-    DataNode *data_node = reinterpret_cast<DataNode *>(curr_value);
-    next_position = get_position(data_node->key_, depth+1);
+    assert(slot_node(curr_value)->is_data());
+    DataNode *data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
+    next_position = get_position(data_node->hash_, depth+1);
     array_node->access(next_position)->store(curr_value);
   }
   assert(array_node->is_array());
 
-  if (loc->compare_exchange_strong(curr_value, array_node)) {
+  if (loc->compare_exchange_strong(curr_value, array_slot(array_node))) {
     return;
   } else {
-    assert(loc->load() != array_node);
+    assert(loc->load() != array_slot(array_node));
     array_node->access(next_position)->store(nullptr);
     delete array_node;
   }
@@ -701,9 +1826,9 @@ expand_map(Location * loc, Node * curr_value, size_t depth) {
 
 template<class Key, class Value, class Functor>
 uint64_t HashMap<Key, Value, Functor>::
-get_position(Key &key, size_t depth) {
-  const uint64_t *long_array = reinterpret_cast<uint64_t *>(&key);
-  const size_t max_length = sizeof(Key) / (64 / 8);
+get_position(const Hash &hash, size_t depth) {
+  const uint64_t *long_array = reinterpret_cast<const uint64_t *>(&hash);
+  const size_t max_length = sizeof(Hash) / (64 / 8);
 
   assert(depth <= max_depth());
   if (depth == 0) {
@@ -762,26 +1887,150 @@ get_position(Key &key, size_t depth) {
 template<class Key, class Value, class Functor>
 uint64_t HashMap<Key, Value, Functor>::
 max_depth() {
-  uint64_t max_depth = sizeof(Key)*8;
+  uint64_t max_depth = sizeof(Hash)*8;
   max_depth -= primary_array_pow_;
-  max_depth = std::ceil(max_depth / secondary_array_pow_);
-  max_depth++;
+  // Round up, so the last depth takes the remaining bits.
+  max_depth = (max_depth + secondary_array_pow_ - 1) / secondary_array_pow_;
 
   return max_depth;
 }
 
 template<class Key, class Value, class Functor>
 void HashMap<Key, Value, Functor>::
-print_key(Key &key) {
+print_key(const Key &key) {
+  Functor functor;
+  Hash hash = functor.hash(key);
   size_t max_depth_ = max_depth();
   std::cout << "K(" << key << ") :";
   for (size_t i = 0; i <= max_depth_; i++) {
-    uint64_t temp = get_position(key, i);
+    uint64_t temp = get_position(hash, i);
     std::cout << temp << "-";
   }
   std::cout << "\n" << std::endl;
 }  // print_key
 
+template<class Key, class Value, class Functor>
+template<class Func>
+void HashMap<Key, Value, Functor>::
+for_each(Func fn, size_t part, size_t num_parts) {
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  assert(part < num_parts);
+  const size_t begin = primary_array_size_ * part / num_parts;
+  const size_t end = primary_array_size_ * (part + 1) / num_parts;
+  for (size_t i = begin; i < end; i++) {
+    for_each(&(primary_array_[i]), fn);
+  }
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+}  // for_each
+
+template<class Key, class Value, class Functor>
+template<class Func>
+void HashMap<Key, Value, Functor>::
+for_each(Location *loc, Func &fn) {
+  Node *curr_value;
+  DataNode *data_node;
+  while (true) {
+    if (!hp_watch_and_get_value(loc, curr_value)) {
+      continue;
+    } else if (curr_value == nullptr) {
+      return;
+    } else if (is_array_slot(curr_value)) {
+      // Array nodes are not freed while the hash map exists.
+      hp_unwatch();
+      ArrayNode *array_node =
+          reinterpret_cast<ArrayNode *>(slot_node(curr_value));
+      for (size_t i = 0; i < secondary_array_size_; i++) {
+        for_each(array_node->access(i), fn);
+      }
+      return;
+    }
+
+    assert(slot_node(curr_value)->is_data());
+    data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
+    if (data_node->access_count_.load() >= 0) {
+      break;
+    }
+    hp_unwatch();
+    if (loc->load() == curr_value) {  // It is deleted.
+      return;
+    }
+    // It was replaced by an update, visit its replacement.
+  }
+
+  Key key = node_key(data_node);
+  Value value = data_node->value_;
+  hp_unwatch();
+  fn(key, value);
+}  // for_each
+
+template<class Key, class Value, class Functor>
+void HashMap<Key, Value, Functor>::
+stats(Stats *stats) {
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+  *stats = Stats();
+  stats->array_nodes.assign(max_depth() + 1, 0);
+  stats->data_nodes.assign(max_depth() + 1, 0);
+  stats->bytes = sizeof(*this) + primary_array_size_ * sizeof(Location);
+  for (size_t i = 0; i < primary_array_size_; i++) {
+    this->stats(&(primary_array_[i]), 0, stats);
+  }
+  assert(hp_check_empty() && " Error: Function Did not release hp watch ");
+}  // stats
+
+template<class Key, class Value, class Functor>
+void HashMap<Key, Value, Functor>::
+stats(Location *loc, size_t depth, Stats *stats) {
+  Node *curr_value;
+  while (!hp_watch_and_get_value(loc, curr_value)) {}
+
+  if (curr_value == nullptr) {
+    return;
+  } else if (is_array_slot(curr_value)) {
+    hp_unwatch();
+    ArrayNode *array_node = reinterpret_cast<ArrayNode *>(slot_node(curr_value));
+    stats->array_nodes[depth]++;
+    stats->bytes += sizeof(ArrayNode) + secondary_array_size_ * sizeof(Location);
+    for (size_t i = 0; i < secondary_array_size_; i++) {
+      this->stats(array_node->access(i), depth + 1, stats);
+    }
+    return;
+  }
+
+  DataNode *data_node = reinterpret_cast<DataNode *>(slot_node(curr_value));
+  stats->bytes += sizeof(DataNode);
+  if (data_node->access_count_.load() < 0) {
+    stats->removed_nodes++;
+  } else {
+    stats->keys++;
+    stats->data_nodes[depth]++;
+  }
+  hp_unwatch();
+}  // stats
+
+template<class Key, class Value, class Functor>
+void HashMap<Key, Value, Functor>::
+depth_histogram(std::vector<uint64_t> *histogram) {
+  histogram->assign(max_depth() + 1, 0);
+  for (size_t i = 0; i < primary_array_size_; i++) {
+    depth_histogram(primary_array_[i].load(), 0, histogram);
+  }
+}  // depth_histogram
+
+template<class Key, class Value, class Functor>
+void HashMap<Key, Value, Functor>::
+depth_histogram(Node *node, size_t depth, std::vector<uint64_t> *histogram) {
+  if (node == nullptr) {
+    return;
+  } else if (!is_array_slot(node)) {
+    (*histogram)[depth]++;
+  } else {
+    ArrayNode *array_node = reinterpret_cast<ArrayNode *>(slot_node(node));
+    for (size_t i = 0; i < secondary_array_size_; i++) {
+      depth_histogram(array_node->access(i)->load(), depth + 1, histogram);
+    }
+  }
+}  // depth_histogram
+
 }  // namespace wf
 }  // namespace containers
 }  // namespace tervel
@@ -25,12 +25,16 @@ THE SOFTWARE.
 #ifndef TERVEL_CONTAINER_WF_HASH_MAP_WFHM_HASHMAP_H
 #define TERVEL_CONTAINER_WF_HASH_MAP_WFHM_HASHMAP_H
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
 #include <cmath>
 #include <stdlib.h>
+#include <vector>
 
+#include <tervel/containers/wf/hash-map/hash_traits.h>
 #include <tervel/util/util.h>
+#include <tervel/util/tervel_metrics.h>
 // TODO(Steven):
 //
 // Document code
@@ -43,22 +47,6 @@ THE SOFTWARE.
 namespace tervel {
 namespace containers {
 namespace wf {
-/**
- * A default Functor implementation
- *
- */
-template<class Key, class Value>
-struct default_functor {
-  Key hash(Key k) {
-    return k;
-  }
-
-  bool key_equals(Key a, Key b) {
-    return a == b;
-  }
-};
-
-
 
 /**
  * A wait-free hash map implementation.
@@ -67,17 +55,24 @@ struct default_functor {
  *
  * Functor should have the following functions:
  *   -Key hash(Key k) (where hash(a) == (hash(b) implies a == b
+ *       The default functor hashes keys with hash_traits<Key>.
  *   -bool key_equals (Key a, Key b)
  *       Important Note: the hashed value of keys will be passed in.
  *
  */
 template< class Key, class Value, class Functor = default_functor<Key, Value> >
 class HashMapNoDelete {
+  static_assert(sizeof(Key) % sizeof(uint64_t) == 0,
+      "Positions are taken from 64 bit words of the hashed key, use HashMap "
+      "for narrower keys");
+
  public:
   class ValueAccessor;
 
   HashMapNoDelete(uint64_t capacity, uint64_t expansion_rate = 3)
-    : primary_array_size_(tervel::util::round_to_next_power_of_two(capacity))
+    : primary_array_size_(uint64_t(1) <<
+        tervel::util::round_to_next_power_of_two(
+            std::max<uint64_t>(capacity, 2)))
     , primary_array_pow_(std::log2(primary_array_size_))
     , secondary_array_size_(std::pow(2, expansion_rate))
     , secondary_array_pow_(expansion_rate)
@@ -212,11 +207,27 @@ class HashMapNoDelete {
    */
   void print_key(Key &key);
 
+  /**
+   * Counts the keys stored at each depth, which shows how well the hash
+   * spreads keys over the primary array.
+   * Not Thread Safe!
+   *
+   * @param histogram: entry i receives the number of keys at depth i
+   */
+  void depth_histogram(std::vector<uint64_t> *histogram);
+
  private:
   class Node;
   friend class Node;
   typedef std::atomic<Node *> Location;
 
+  /**
+   * Adds the keys reachable from node, which is at the specified depth, to
+   * histogram.
+   */
+  void depth_histogram(Node *node, size_t depth,
+      std::vector<uint64_t> *histogram);
+
 
   /**
    * This class is used to differentiate between data_nodes and array_nodes/
@@ -346,6 +357,9 @@ class HashMapNoDelete {
 template<class Key, class Value, class Functor>
 bool HashMapNoDelete<Key, Value, Functor>::
 at(Key key, ValueAccessor &va) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(at)
+  #endif
   Functor functor;
   key = functor.hash(key);
 
@@ -385,6 +399,9 @@ at(Key key, ValueAccessor &va) {
 template<class Key, class Value, class Functor>
 bool HashMapNoDelete<Key, Value, Functor>::
 insert(Key key, Value value) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(insert)
+  #endif
   Functor functor;
   key = functor.hash(key);
 
@@ -534,6 +551,30 @@ print_key(Key &key) {
   std::cout << "\n" << std::endl;
 }  // print_key
 
+template<class Key, class Value, class Functor>
+void HashMapNoDelete<Key, Value, Functor>::
+depth_histogram(std::vector<uint64_t> *histogram) {
+  histogram->assign(max_depth() + 1, 0);
+  for (size_t i = 0; i < primary_array_size_; i++) {
+    depth_histogram(primary_array_[i].load(), 0, histogram);
+  }
+}  // depth_histogram
+
+template<class Key, class Value, class Functor>
+void HashMapNoDelete<Key, Value, Functor>::
+depth_histogram(Node *node, size_t depth, std::vector<uint64_t> *histogram) {
+  if (node == nullptr) {
+    return;
+  } else if (node->is_data()) {
+    (*histogram)[depth]++;
+  } else {
+    ArrayNode *array_node = reinterpret_cast<ArrayNode *>(node);
+    for (size_t i = 0; i < secondary_array_size_; i++) {
+      depth_histogram(array_node->access(i)->load(), depth + 1, histogram);
+    }
+  }
+}  // depth_histogram
+
 }  // namespace wf
 }  // namespace containers
 }  // namespace tervel
@@ -178,6 +178,17 @@ class RingBuffer {
    */
   bool isEmpty(int64_t tail, int64_t head);
 
+  /**
+   * @brief Sets the progress assurance settings used by this buffer.
+   * @details By default the settings of the Tervel object are used. This is
+   * not thread safe and the settings must outlive the buffer.
+   *
+   * @param settings the settings to use, nullptr for the Tervel object's.
+   */
+  void set_progress_settings(util::ProgressSettings *settings) {
+    prog_settings_ = settings;
+  }
+
   /**
    * @brief Enqueues the passed value into the buffer
    * @details This function attempts to enqueue the passed value.
@@ -439,6 +450,7 @@ class RingBuffer {
   std::atomic<int64_t> head_ {0};
   std::atomic<int64_t> tail_ {0};
   std::unique_ptr<std::atomic<uintptr_t>[]> array_;
+  util::ProgressSettings *prog_settings_ {nullptr};
 
 };  // class RingBuffer<Value>
 
@@ -116,8 +116,11 @@ getValueType(uintptr_t val) {
 template<typename T>
 bool RingBuffer<T>::
 dequeue(T &value) {
-  tervel::util::ProgressAssurance::check_for_announcement();
-  util::ProgressAssurance::Limit progAssur;
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(dequeue)
+  #endif
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr, prog_settings_);
+  util::ProgressAssurance::Limit progAssur(prog_settings_);
 
   while(progAssur.notDelayed(0)) {
     if (isEmpty()) {
@@ -205,7 +208,7 @@ dequeue(T &value) {
   } // outer loop.
 
   DequeueOp *op = new DequeueOp(this);
-  tervel::util::ProgressAssurance::make_announcement(op);
+  tervel::util::ProgressAssurance::make_announcement(op, prog_settings_);
   bool res = op->result(value);
   op->safe_delete();
   return res;
@@ -215,8 +218,11 @@ dequeue(T &value) {
 template<typename T>
 bool RingBuffer<T>::
 enqueue(T value) {
-  tervel::util::ProgressAssurance::check_for_announcement();
-  util::ProgressAssurance::Limit progAssur;
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(enqueue)
+  #endif
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr, prog_settings_);
+  util::ProgressAssurance::Limit progAssur(prog_settings_);
 
   while(progAssur.notDelayed(0)) {
     if (isFull()) {
@@ -281,7 +287,7 @@ enqueue(T value) {
   }  // outer while(progAssur.notDelayed())
 
   EnqueueOp *op = new EnqueueOp(this, value);
-  tervel::util::ProgressAssurance::make_announcement(op);
+  tervel::util::ProgressAssurance::make_announcement(op, prog_settings_);
   bool res = op->result();
   op->safe_delete();
   return res;
@@ -55,6 +55,14 @@ class Stack {
   bool push(T v);
   bool pop(T &v);
 
+  /**
+   * Sets the progress assurance settings used by this stack, by default the
+   * settings of the Tervel object are used. The settings must outlive the stack.
+   */
+  void set_progress_settings(util::ProgressSettings *settings) {
+    prog_settings_ = settings;
+  }
+
   class Node;
   class Accessor;
   class Helper;
@@ -65,6 +73,7 @@ class Stack {
   DISALLOW_COPY_AND_ASSIGN(Stack);
  private:
   std::atomic<Node *> lst_ __attribute__((aligned(CACHE_LINE_SIZE)));
+  util::ProgressSettings *prog_settings_ {nullptr};
 }; // class Stack
 
 
@@ -50,6 +50,9 @@ namespace wf {
   */
 template<typename T>
 bool Stack<T>::push(T v) {
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(push)
+  #endif
   Node *elem = new Node(v);
 
   // To guarantee wait freedom, we make use of the tervel announcment table.
@@ -57,11 +60,11 @@ bool Stack<T>::push(T v) {
   // by calling check_for_announcement. If an anouncement is found, that means
   // some thread is having trouble completing its operation. By having other
   // threads help the troubled thread, we can guarantee system wide progress. 
-  tervel::util::ProgressAssurance::check_for_announcement();
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr, prog_settings_);
 
   // This limit is a measurement of how many times a thread can fail to complete 
   // its operation before it makes an annoucement.
-  util::ProgressAssurance::Limit progAssur;
+  util::ProgressAssurance::Limit progAssur(prog_settings_);
 
   while (!progAssur.isDelayed()) {
     Accessor access;
@@ -79,7 +82,7 @@ bool Stack<T>::push(T v) {
 
   // If isDelayed() returns true, we add our operation to the announcement table.
   PushOp *op = new PushOp(this, elem);
-  tervel::util::ProgressAssurance::make_announcement(op);
+  tervel::util::ProgressAssurance::make_announcement(op, prog_settings_);
   op->safe_delete();
   return true;
 }  // bool push(T v)
@@ -94,8 +97,11 @@ bool Stack<T>::push(T v) {
   */
 template<typename T>
 bool Stack<T>::pop(T& v) {
-  tervel::util::ProgressAssurance::check_for_announcement();
-  util::ProgressAssurance::Limit progAssur;
+  #if tervel_track_op_latency == tervel_track_enable
+    TERVEL_METRIC_LATENCY(pop)
+  #endif
+  tervel::util::ProgressAssurance::check_for_announcement(nullptr, prog_settings_);
+  util::ProgressAssurance::Limit progAssur(prog_settings_);
 
   while (!progAssur.isDelayed()) {
     Accessor access;
@@ -119,7 +125,7 @@ bool Stack<T>::pop(T& v) {
   } // while (true)
 
   PopOp *op = new PopOp(this);
-  tervel::util::ProgressAssurance::make_announcement(op);
+  tervel::util::ProgressAssurance::make_announcement(op, prog_settings_);
   bool res = op->result(v);
   op->safe_delete();
   return res;
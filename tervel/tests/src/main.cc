@@ -38,6 +38,9 @@ DS_DECLARE_CODE
 
 const std::string op_names[DS_OP_COUNT] = { DS_OP_NAMES };
 op_counter_t ** g_test_results;
+#ifdef USE_PERF_COUNTERS
+PerfCounters ** g_perf_counters;
+#endif
 
 int main(int argc, char **argv) {
 #ifdef USE_CDS
@@ -60,6 +63,9 @@ int main(int argc, char **argv) {
   }
 
   g_test_results = new op_counter_t *[FLAGS_num_threads];
+#ifdef USE_PERF_COUNTERS
+  g_perf_counters = new PerfCounters *[FLAGS_num_threads]();
+#endif
 
   std::string execution_str = "";
   for (int i = 1; i < argc; i++) {
@@ -176,6 +182,15 @@ int main(int argc, char **argv) {
 #ifdef USE_PAPI
   std::cout << papiUtil.results() << std::endl;
 #endif
+#ifdef USE_PERF_COUNTERS
+  if (!FLAGS_perf_events.empty()) {
+    std::cout << PerfCounters::results(g_perf_counters, numThreads) << std::endl;
+  }
+  for (uint64_t i = 0; i < numThreads; i++) {
+    delete g_perf_counters[i];
+  }
+  delete [] g_perf_counters;
+#endif
 
   DS_DESTORY_CODE
 
@@ -41,6 +41,12 @@
   #include "papi_util.h"
 #endif
 
+// Hardware counters through perf_event_open, enabled with -perf_events
+#if defined(__linux__) && !defined(NO_PERF_COUNTERS)
+  #define USE_PERF_COUNTERS
+  #include "perf_counters.h"
+#endif
+
 #define __TERVEL_MACRO_xstr(s) __TERVEL_MACRO_str(s)
 #define __TERVEL_MACRO_str(s) #s
 #define _DS_CONFIG_INDENT "    "
@@ -0,0 +1,245 @@
+/*
+#The MIT License (MIT)
+#
+#Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+#Scalable & Secure Systems (CSE - S3) Lab
+#
+#Permission is hereby granted, free of charge, to any person obtaining a copy
+#of this software and associated documentation files (the "Software"), to deal
+#in the Software without restriction, including without limitation the rights
+#to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#copies of the Software, and to permit persons to whom the Software is
+#furnished to do so, subject to the following conditions:
+#
+#The above copyright notice and this permission notice shall be included in
+#all copies or substantial portions of the Software.
+#
+#THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+#THE SOFTWARE.
+#
+*/
+
+#ifndef __PERF_COUNTERS_H_
+#define __PERF_COUNTERS_H_
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+DEFINE_string(perf_events, "", "A comma separated list of hardware events "
+  "counted per thread around the benchmark loop with perf_event_open: cycles, "
+  "instructions, l1d_misses, llc_misses, branch_misses, node_misses, "
+  "task_clock, context_switches or 'all' for each of these. A raw event is "
+  "given as name=0xconfig, e.g. hitm=0x4d2 for "
+  "MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM on Skylake.");
+
+/**
+ * Counts hardware events for the calling thread through perf_event_open,
+ * without depending on PAPI. Each event is opened on its own so that the
+ * kernel can multiplex them when there are more events than counters, counts
+ * are scaled by the fraction of the time the event was scheduled. Events the
+ * cpu or kernel do not support are skipped with a warning.
+ */
+class PerfCounters {
+  public:
+    explicit PerfCounters(std::string events = FLAGS_perf_events) {
+      std::stringstream ss(events);
+      std::string name;
+      while (std::getline(ss, name, EVENT_LIST_DELIMITER_)) {
+        if (name == "all") {
+          for (const char *e : {"cycles", "instructions", "l1d_misses",
+                "llc_misses", "branch_misses", "node_misses", "task_clock",
+                "context_switches"}) {
+            add_event(e);
+          }
+        } else if (!name.empty()) {
+          add_event(name);
+        }
+      }
+    }
+
+    ~PerfCounters() {
+      for (auto &e : events_) {
+        close(e.fd);
+      }
+    }
+
+    bool empty() { return events_.empty(); }
+
+    void start() {
+      for (auto &e : events_) {
+        ioctl(e.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(e.fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+
+    void stop() {
+      for (auto &e : events_) {
+        ioctl(e.fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+      for (auto &e : events_) {
+        // value, time enabled, time running
+        uint64_t data[3] = {0, 0, 0};
+        if (read(e.fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+          e.value = 0;
+        } else if (data[2] < data[1]) {
+          e.value = static_cast<uint64_t>(
+              static_cast<double>(data[0]) * data[1] / data[2]);
+        } else {
+          e.value = data[0];
+        }
+      }
+    }
+
+    /**
+     * @return the totals and per thread counts of counters as yaml, counters
+     * may contain nullptr entries for threads without counters. Totals are
+     * matched by event name, as an event may have failed to open in only some
+     * of the threads.
+     */
+    static std::string results(PerfCounters **counters, int numThreads) {
+      // Event names in the order they were first opened, with their totals
+      std::vector<std::pair<std::string, uint64_t>> totals;
+      for (int i = 0; i < numThreads; i++) {
+        if (counters[i] == nullptr) {
+          continue;
+        }
+        for (auto &e : counters[i]->events_) {
+          size_t j = 0;
+          while (j < totals.size() && totals[j].first != e.name) {
+            j++;
+          }
+          if (j == totals.size()) {
+            totals.push_back(std::make_pair(e.name, 0));
+          }
+          totals[j].second += e.value;
+        }
+      }
+      if (totals.empty()) {
+        return "";
+      }
+
+      std::string res("  PerfCounters : \n");
+      res += "    totals : \n";
+      for (auto &t : totals) {
+        res += "      " + t.first + " : " + std::to_string(t.second) + "\n";
+      }
+
+      res += "    per_thread : \n";
+      for (int i = 0; i < numThreads; i++) {
+        if (counters[i] == nullptr) {
+          continue;
+        }
+        res += "      - TID : " + std::to_string(i) + "\n";
+        for (auto &e : counters[i]->events_) {
+          res += "        " + e.name + " : " + std::to_string(e.value) + "\n";
+        }
+      }
+      return res;
+    }
+
+  private:
+    struct Event {
+      std::string name;
+      int fd;
+      uint64_t value;
+    };
+
+    std::vector<Event> events_;
+    static const char EVENT_LIST_DELIMITER_ = ',';
+
+    static uint64_t cache_event(uint64_t cache, uint64_t result) {
+      return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+    }
+
+    void add_event(const std::string &name) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+
+      if (name == "cycles") {
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      } else if (name == "instructions") {
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      } else if (name == "branch_misses") {
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      } else if (name == "l1d_misses") {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cache_event(PERF_COUNT_HW_CACHE_L1D,
+            PERF_COUNT_HW_CACHE_RESULT_MISS);
+      } else if (name == "llc_misses") {
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cache_event(PERF_COUNT_HW_CACHE_LL,
+            PERF_COUNT_HW_CACHE_RESULT_MISS);
+      } else if (name == "node_misses") {
+        // Loads which were served by a remote NUMA node
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cache_event(PERF_COUNT_HW_CACHE_NODE,
+            PERF_COUNT_HW_CACHE_RESULT_MISS);
+      } else if (name == "task_clock") {
+        // Nanoseconds the thread was running
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_TASK_CLOCK;
+      } else if (name == "context_switches") {
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+      } else if (name.find('=') != std::string::npos) {
+        attr.type = PERF_TYPE_RAW;
+        attr.config = strtoull(name.c_str() + name.find('=') + 1, nullptr, 0);
+      } else {
+        warn("Unknown perf event (" + name + ")");
+        return;
+      }
+
+      attr.disabled = 1;
+      // Software events such as context switches only occur in the kernel
+      attr.exclude_kernel = (attr.type != PERF_TYPE_SOFTWARE);
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+          PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      // Counts the calling thread on any cpu
+      int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+      if (fd == -1) {
+        warn("perf event (" + name + ") is not available: " +
+            std::string(strerror(errno)));
+        return;
+      }
+      events_.push_back({name.substr(0, name.find('=')), fd, 0});
+    }
+
+    // Each thread opens the same events, so each warning is printed once.
+    static void warn(const std::string &msg) {
+      static std::mutex mutex;
+      static std::vector<std::string> printed;
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &p : printed) {
+        if (p == msg) {
+          return;
+        }
+      }
+      printed.push_back(msg);
+      std::cout << "# [Warn] : " << msg << std::endl;
+    }
+};
+
+#endif  // __PERF_COUNTERS_H_
@@ -70,10 +70,24 @@ void run(uint64_t thread_id, char **argv) {
 
   OP_RAND
 
+#ifdef USE_PERF_COUNTERS
+  PerfCounters *perf_counters = nullptr;
+  if (!FLAGS_perf_events.empty()) {
+    perf_counters = new PerfCounters();
+    g_perf_counters[thread_id] = perf_counters;
+  }
+#endif
+
   // Wait for start signal
   g_thread_signal.ready();
   while (g_thread_signal.wait());
 
+#ifdef USE_PERF_COUNTERS
+  if (perf_counters != nullptr) {
+    perf_counters->start();
+  }
+#endif
+
   /** Update this when adding a new data structure **/
   __attribute__((unused)) int op = DS_OP_COUNT % (1 + thread_id);
   while (g_thread_signal.execute()) {
@@ -96,6 +110,12 @@ void run(uint64_t thread_id, char **argv) {
     exit(-1);
   }
 
+#ifdef USE_PERF_COUNTERS
+  if (perf_counters != nullptr) {
+    perf_counters->stop();
+  }
+#endif
+
   g_thread_signal.finished();
 
   {
@@ -36,7 +36,24 @@
 
 typedef int64_t Value;
 typedef int64_t Key;
-typedef typename tervel::containers::wf::HashMap<Key, Value> container_t;
+// Define HASHMAP_IDENTITY_HASH to use keys as their own hash, which shows the
+// depth distribution without the default hash.
+#ifdef HASHMAP_IDENTITY_HASH
+typedef tervel::containers::wf::identity_functor<Key, Value> Functor;
+#define HASHMAP_HASH_NAME "identity"
+#else
+typedef tervel::containers::wf::default_functor<Key, Value> Functor;
+#define HASHMAP_HASH_NAME "default"
+#endif
+// Define HASHMAP_COPY_READ to find keys with get, which copies the value
+// instead of incrementing the key's access counter. Values read with get
+// may not be written through a ValueAccessor, so updates then use update.
+#ifdef HASHMAP_COPY_READ
+#define HASHMAP_READ_NAME "copy"
+#else
+#define HASHMAP_READ_NAME "accessor"
+#endif
+typedef typename tervel::containers::wf::HashMap<Key, Value, Functor> container_t;
 typedef typename container_t::ValueAccessor Accessor;
 
 
@@ -45,6 +62,7 @@ typedef typename container_t::ValueAccessor Accessor;
 DEFINE_int32(prefill, 0, "The number elements to place in the data structure on init.");
 DEFINE_int32(capacity, 32768, "The initial capacity of the hashmap, should be a power of two.");
 DEFINE_int32(expansion_factor, 5, "The size by which the hash map expands on collision. 2^x = positions, where x is the specified value.");
+DEFINE_int32(key_range, USHRT_MAX, "Operations use keys in [1, key_range], a small range makes removes contend with inserts on a few hot keys.");
 
 
 #define DS_DECLARE_CODE \
@@ -66,26 +84,67 @@ container = new container_t(FLAGS_capacity, FLAGS_expansion_factor); \
 \
 std::default_random_engine generator; \
 std::uniform_int_distribution<Value> largeValue(0, UINT_MAX); \
+std::vector<std::pair<Key, Value>> prefill_pairs; \
 for (int i = 0; i < FLAGS_prefill; i++) { \
   Value x = largeValue(generator) & (~0x3); \
-  container->insert(x, x); \
-}
+  prefill_pairs.emplace_back(x, x); \
+} \
+container->bulk_load(prefill_pairs.begin(), prefill_pairs.end());
 
 #define DS_NAME "WF Hash Map"
 
 #define DS_CONFIG_STR \
     "\n" _DS_CONFIG_INDENT "Prefill : " + std::to_string(FLAGS_prefill) \
   + "\n" _DS_CONFIG_INDENT "Capacity : " + std::to_string(FLAGS_capacity) \
-  + "\n" _DS_CONFIG_INDENT "ExpansionFactor : " + std::to_string(FLAGS_expansion_factor) + "" + tervel_obj->get_config_str() + ""
+  + "\n" _DS_CONFIG_INDENT "ExpansionFactor : " + std::to_string(FLAGS_expansion_factor) + "" \
+  + "\n" _DS_CONFIG_INDENT "KeyRange : " + std::to_string(FLAGS_key_range) + "" \
+  + "\n" _DS_CONFIG_INDENT "Hash : " HASHMAP_HASH_NAME "" \
+  + "\n" _DS_CONFIG_INDENT "Read : " HASHMAP_READ_NAME "" + tervel_obj->get_config_str() + ""
+
+// A per depth count as a list
+inline std::string depth_str(const std::vector<uint64_t> &histogram) {
+  std::string res = "[";
+  for (size_t i = 0; i < histogram.size(); i++) {
+    res += (i == 0 ? "" : ", ") + std::to_string(histogram[i]);
+  }
+  return res + "]";
+}
+
+inline std::string stats_str(container_t *container) {
+  container_t::Stats stats;
+  container->stats(&stats);
+  return "\n" _DS_CONFIG_INDENT "depths : " + depth_str(stats.data_nodes) +
+    "\n" _DS_CONFIG_INDENT "array_nodes : " + depth_str(stats.array_nodes) +
+    "\n" _DS_CONFIG_INDENT "removed_nodes : " +
+        std::to_string(stats.removed_nodes) +
+    "\n" _DS_CONFIG_INDENT "bytes : " + std::to_string(stats.bytes);
+}
 
 #define DS_STATE_STR \
-   "\n" _DS_CONFIG_INDENT "size : " + std::to_string(container->size()) + ""
+   "\n" _DS_CONFIG_INDENT "size : " + std::to_string(container->size()) + "" \
+   + stats_str(container) + ""
 
 #define OP_RAND \
-  std::uniform_int_distribution<Value> random(1, USHRT_MAX);
+  std::uniform_int_distribution<Value> random(1, FLAGS_key_range);
 
 
-#define OP_CODE \
+#ifdef HASHMAP_COPY_READ
+#define FIND_OP_CODE \
+  MACRO_OP_MAKER(0, { \
+    Value value = random(generator); \
+    opRes = container->get(value, &value); \
+  } \
+  )
+#define UPDATE_OP_CODE \
+  MACRO_OP_MAKER(2, { \
+    Value key = random(generator); \
+    Value value; \
+    opRes = container->get(key, &value) && \
+        container->update(key, value, value * 2); \
+  } \
+  )
+#else
+#define FIND_OP_CODE \
   MACRO_OP_MAKER(0, { \
     Accessor va; \
     Value value = random(generator); \
@@ -94,12 +153,8 @@ for (int i = 0; i < FLAGS_prefill; i++) { \
       value = *(va.value()); \
     } \
   } \
-  ) \
-  MACRO_OP_MAKER(1, { \
-    Value value = random(generator); \
-    opRes = container->insert(value, value); \
-  } \
-  ) \
+  )
+#define UPDATE_OP_CODE \
   MACRO_OP_MAKER(2, { \
     Accessor va; \
     Value value = random(generator); \
@@ -110,7 +165,17 @@ for (int i = 0; i < FLAGS_prefill; i++) { \
       opRes = temp->compare_exchange_strong(value, value * 2); \
     } \
   } \
+  )
+#endif
+
+#define OP_CODE \
+  FIND_OP_CODE \
+  MACRO_OP_MAKER(1, { \
+    Value value = random(generator); \
+    opRes = container->insert(value, value); \
+  } \
   ) \
+  UPDATE_OP_CODE \
   MACRO_OP_MAKER(3, { \
     Value value = random(generator); \
     opRes = container->remove(value); \
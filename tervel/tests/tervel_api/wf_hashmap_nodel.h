@@ -36,7 +36,16 @@
 
 typedef int64_t Value;
 typedef int64_t Key;
-typedef typename tervel::containers::wf::HashMapNoDelete<Key, Value> container_t;
+// Define HASHMAP_IDENTITY_HASH to use keys as their own hash, which shows the
+// depth distribution without the default hash.
+#ifdef HASHMAP_IDENTITY_HASH
+typedef tervel::containers::wf::identity_functor<Key, Value> Functor;
+#define HASHMAP_HASH_NAME "identity"
+#else
+typedef tervel::containers::wf::default_functor<Key, Value> Functor;
+#define HASHMAP_HASH_NAME "default"
+#endif
+typedef typename tervel::containers::wf::HashMapNoDelete<Key, Value, Functor> container_t;
 typedef typename container_t::ValueAccessor Accessor;
 
 
@@ -76,9 +85,22 @@ for (int i = 0; i < FLAGS_prefill; i++) { \
 #define DS_CONFIG_STR \
     "\n" _DS_CONFIG_INDENT "Prefill : " + std::to_string(FLAGS_prefill) \
   + "\n" _DS_CONFIG_INDENT "Capacity : " + std::to_string(FLAGS_capacity) \
-  + "\n" _DS_CONFIG_INDENT "ExpansionFactor : " + std::to_string(FLAGS_expansion_factor) + ""
+  + "\n" _DS_CONFIG_INDENT "ExpansionFactor : " + std::to_string(FLAGS_expansion_factor) + "" \
+  + "\n" _DS_CONFIG_INDENT "Hash : " HASHMAP_HASH_NAME ""
+
+// The number of keys at each depth of the hash map
+inline std::string depth_str(container_t *container) {
+  std::vector<uint64_t> histogram;
+  container->depth_histogram(&histogram);
+  std::string res = "[";
+  for (size_t i = 0; i < histogram.size(); i++) {
+    res += (i == 0 ? "" : ", ") + std::to_string(histogram[i]);
+  }
+  return res + "]";
+}
 
-#define DS_STATE_STR " "
+#define DS_STATE_STR \
+   "\n" _DS_CONFIG_INDENT "depths : " + depth_str(container) + ""
 
 #define OP_RAND \
   std::uniform_int_distribution<Value> random(1, USHRT_MAX);
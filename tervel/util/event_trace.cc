@@ -0,0 +1,64 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <tervel/util/event_trace.h>
+
+#include <assert.h>
+
+namespace tervel {
+namespace util {
+
+TraceRing::TraceRing(size_t size)
+    : mask_(size - 1)
+    , events_(new Event[size]()) {
+  assert(size > 0 && (size & (size - 1)) == 0 &&
+      "The trace ring size must be a power of two");
+}
+
+void TraceRing::snapshot(std::vector<Event> *out) {
+  const uint64_t size = mask_ + 1;
+  const uint64_t end = head_.load(std::memory_order_acquire);
+  const uint64_t start = end > size ? end - size : 0;
+
+  std::vector<Event> temp;
+  temp.reserve(end - start);
+  for (uint64_t i = start; i < end; i++) {
+    temp.push_back(events_[i & mask_]);
+  }
+
+  // The writer may be writing event head, which shares a slot with event
+  // head - size, so only events after that one are known to be intact.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  uint64_t first = start;
+  if (head >= size && head - size + 1 > first) {
+    first = head - size + 1;
+  }
+  for (uint64_t i = first; i < end; i++) {
+    out->push_back(temp[i - start]);
+  }
+}
+
+}  // namespace util
+}  // namespace tervel
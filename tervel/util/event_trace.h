@@ -0,0 +1,89 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_UTIL_EVENT_TRACE_H_
+#define TERVEL_UTIL_EVENT_TRACE_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tervel/util/util.h>
+
+namespace tervel {
+namespace util {
+
+/**
+ * A fixed size ring of timestamped events written by a single thread.
+ *
+ * Once the ring is full the oldest events are overwritten, so it always holds
+ * the most recent events leading up to a stall. Recording an event is two
+ * stores and a release store of the head. Other threads may take a snapshot
+ * at any time without blocking the writer, events which may have been
+ * overwritten while they were copied are dropped from the snapshot.
+ */
+class TraceRing {
+ public:
+  struct Event {
+    uint64_t timestamp;
+    uint64_t code;
+  };
+
+  /**
+   * @param size the number of events kept, must be a power of two.
+   */
+  explicit TraceRing(size_t size = TERVEL_TRACE_RING_SIZE);
+
+  /**
+   * Records an event, must only be called by the owning thread.
+   */
+  void record(uint64_t timestamp, uint64_t code) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    Event &event = events_[head & mask_];
+    event.timestamp = timestamp;
+    event.code = code;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  /**
+   * Appends the events currently in the ring to out, oldest first.
+   */
+  void snapshot(std::vector<Event> *out);
+
+ private:
+  const uint64_t mask_;
+  std::unique_ptr<Event[]> events_;
+  // The number of events ever recorded
+  std::atomic<uint64_t> head_ {0};
+
+  DISALLOW_COPY_AND_ASSIGN(TraceRing);
+};
+
+}  // namespace util
+}  // namespace tervel
+
+#endif  // TERVEL_UTIL_EVENT_TRACE_H_
@@ -28,4 +28,5 @@ namespace tervel {
 
 __thread void * tl_control_word;
 __thread ThreadContext * tl_thread_info;
+__thread util::EventTracker * tl_event_tracker;
 }  // namespace tervel
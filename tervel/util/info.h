@@ -46,6 +46,8 @@ THE SOFTWARE.
 namespace tervel {
 extern __thread void * tl_control_word;
 extern __thread ThreadContext * tl_thread_info;
+// The thread's EventTracker, so that metrics do not go through tl_thread_info
+extern __thread util::EventTracker * tl_event_tracker;
 }  // namespace tervel
 
 #endif  //  TERVEL_UTIL_INFO_H_
@@ -25,23 +25,74 @@ THE SOFTWARE.
 #include <tervel/util/memory/hp/hazard_pointer.h>
 #include <tervel/util/memory/hp/hp_element.h>
 #include <tervel/util/tervel_metrics.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef TERVEL_MEM_HP_ASYMMETRIC_FENCE
+  #include <linux/membarrier.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
 namespace tervel {
 namespace util {
 namespace memory {
 namespace hp {
 
-HazardPointer::HazardPointer(int num_threads)
+#ifdef TERVEL_MEM_HP_ASYMMETRIC_FENCE
+namespace {
+/**
+ * Registers the process for expedited private membarriers.
+ * @return whether or not they can be used.
+ */
+bool register_membarrier() {
+  long cmds = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0);
+  if (cmds < 0 || !(cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED)) {
+    return false;
+  }
+  return syscall(__NR_membarrier,
+        MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+}
+}  // namespace
+
+const bool HazardPointer::asymmetric_fence_ = register_membarrier();
+#else
+const bool HazardPointer::asymmetric_fence_ = false;
+#endif
+
+void HazardPointer::reclaimer_fence() {
+#ifdef TERVEL_MEM_HP_ASYMMETRIC_FENCE
+  if (asymmetric_fence_) {
+    long res = syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+    assert(res == 0 && "membarrier failed after successful registration");
+    (void)res;
+  } else {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+#endif
+}
+
+HazardPointer::HazardPointer(int num_threads, size_t slots_per_thread)
   // The total number of slots needed is equal to the number of threads
   // multiples by the number of slots used.
   // Do to the potential of reordering, num_slots_ can not be used to
   // initialize watches.
-  : watches_(new std::atomic<void *>[num_threads *
-        static_cast<size_t>(SlotID::END)])
-  , num_slots_ {num_threads * static_cast<size_t>(SlotID::END)}
+  : slots_per_thread_(slots_per_thread)
+  , watches_(new std::atomic<void *>[num_threads * slots_per_thread])
+  , num_slots_ {num_threads * slots_per_thread}
+  , free_slots_(new PaddedAtomic<uint64_t>[num_threads])
   , hp_list_manager_(num_threads) {
+    assert(slots_per_thread_ >= static_cast<size_t>(SlotID::END) &&
+      "There must be a slot for each named SlotID");
+    assert(slots_per_thread_ - static_cast<size_t>(SlotID::END) <=
+      MAX_DYNAMIC_SLOTS && "Too many hazard pointer slots per thread");
     for (size_t i = 0; i < num_slots_; i++) {
       watches_[i].store(nullptr);
     }
+    for (int i = 0; i < num_threads; i++) {
+      free_slots_[i].store(0);
+    }
   }
 
 HazardPointer::~HazardPointer() {
@@ -51,6 +102,41 @@ HazardPointer::~HazardPointer() {
   // delete watches_; // std::unique_ptr causes this array to be destroyed
 }
 
+HazardPointer::SlotID HazardPointer::acquire_slot() {
+  PaddedAtomic<uint64_t> &bitmap =
+        free_slots_[tervel::tl_thread_info->get_thread_id()];
+  uint64_t used = bitmap.load(std::memory_order_relaxed);
+  const size_t num_dynamic = slots_per_thread_ -
+        static_cast<size_t>(SlotID::END);
+
+  for (size_t i = 0; i < num_dynamic; i++) {
+    if ((used & (1ULL << i)) == 0) {
+      bitmap.store(used | (1ULL << i), std::memory_order_relaxed);
+      return static_cast<SlotID>(static_cast<size_t>(SlotID::END) + i);
+    }
+  }
+
+  // Handing out a slot that is in use would let two guards share a watch, so
+  // running out is fatal in release builds as well.
+  fprintf(stderr, "tervel: no free hazard pointer slots, increase the number"
+    " of slots per thread\n");
+  abort();
+}
+
+void HazardPointer::release_slot(SlotID slot) {
+  size_t i = static_cast<size_t>(slot) - static_cast<size_t>(SlotID::END);
+  assert(static_cast<size_t>(slot) >= static_cast<size_t>(SlotID::END) &&
+    i < slots_per_thread_ - static_cast<size_t>(SlotID::END) &&
+    "Only slots from acquire_slot can be released");
+  assert(value(slot) == nullptr && "Releasing a slot that is still watched");
+
+  PaddedAtomic<uint64_t> &bitmap =
+        free_slots_[tervel::tl_thread_info->get_thread_id()];
+  uint64_t used = bitmap.load(std::memory_order_relaxed);
+  assert((used & (1ULL << i)) != 0 && "Releasing a slot that is not held");
+  bitmap.store(used & ~(1ULL << i), std::memory_order_relaxed);
+}
+
 bool HazardPointer::watch(SlotID slot, Element *descr,
       std::atomic<void *> *address, void *expected,
       HazardPointer * const hazard_pointer) {
@@ -35,6 +35,7 @@ THE SOFTWARE.
 
 #include <tervel/util/info.h>
 #include <tervel/util/util.h>
+#include <tervel/util/padded_atomic.h>
 #include <tervel/util/memory/hp/list_manager.h>
 
 namespace tervel {
@@ -50,14 +51,29 @@ class Element;
  * implementation for Elements, in that we call their on_* functions.
  * This allows for more expressive operations to be performed.
  *
- * If an individual thread requires more than one element to be hazard pointer
- * protected at a single instance, then SlotIDs should be added.
+ * Each thread owns slots_per_thread() contiguous slots. The first
+ * SlotID::END of them are the named SlotIDs below, the rest are handed out on
+ * demand by acquire_slot/release_slot, which is normally done through a
+ * HazardGuard. This allows algorithms that protect several elements at once to
+ * be written without adding more named SlotIDs.
  */
 class HazardPointer {
  public:
   enum class SlotID : size_t {SHORTUSE = 0, SHORTUSE2, PROG_ASSUR, END};
 
-  explicit HazardPointer(int num_threads);
+  /**
+   * The maximum number of slots per thread that can be handed out by
+   * acquire_slot, limited by the size of the per thread bitmap.
+   */
+  static constexpr size_t MAX_DYNAMIC_SLOTS = 64;
+
+  /**
+   * @param num_threads the number of threads
+   * @param slots_per_thread the number of slots each thread has, including
+   * the named SlotIDs.
+   */
+  explicit HazardPointer(int num_threads,
+        size_t slots_per_thread = TERVEL_MEM_HP_NUM_SLOTS);
   ~HazardPointer();
 
   // -------
@@ -162,7 +178,12 @@ class HazardPointer {
   void watch(SlotID slot, void *value) {
     int temp = get_slot(slot);
     assert(watches_[temp].load() == nullptr);
+#ifdef TERVEL_MEM_HP_ASYMMETRIC_FENCE
+    watches_[temp].store(value, std::memory_order_release);
+    reader_fence();
+#else
     watches_[temp].store(value);
+#endif
     assert(watches_[temp].load() == value);
   }
 
@@ -196,6 +217,51 @@ class HazardPointer {
     return false;
   }
 
+  /**
+   * Reserves one of the calling thread's unnamed slots. The slot must be
+   * returned with release_slot once it is no longer needed. Aborts if all of
+   * the thread's slots are reserved.
+   *
+   * @return the SlotID of the reserved slot.
+   */
+  SlotID acquire_slot();
+
+  /**
+   * Returns a slot reserved by acquire_slot. The slot must not hold a watch.
+   *
+   * @param slot the slot to return
+   */
+  void release_slot(SlotID slot);
+
+  /**
+   * Orders a watch before the following re-read of the watched address.
+   * With TERVEL_MEM_HP_ASYMMETRIC_FENCE and a working membarrier this is only
+   * a compiler barrier, as reclaimer_fence() forces the ordering on the
+   * reading threads. Otherwise it is a full fence.
+   */
+  static void reader_fence() {
+    if (asymmetric_fence_) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } else {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  /**
+   * Must be called by a thread before it checks whether elements are watched
+   * in order to free them. With TERVEL_MEM_HP_ASYMMETRIC_FENCE this issues a
+   * process wide memory barrier, making all watches published before it
+   * visible. Otherwise it does nothing.
+   */
+  static void reclaimer_fence();
+
+  /**
+   * @return the number of slots each thread has.
+   */
+  size_t slots_per_thread() {
+    return slots_per_thread_;
+  }
+
  private:
   /**
    * This function calculates a the position of a threads slot for the
@@ -204,15 +270,30 @@ class HazardPointer {
    * @param slot The slot id to get the position of
    */
   size_t get_slot(SlotID id) {
-    size_t s = static_cast<size_t>(id) + (static_cast<size_t>(SlotID::END) *
+    assert(static_cast<size_t>(id) < slots_per_thread_);
+    size_t s = static_cast<size_t>(id) + (slots_per_thread_ *
           tervel::tl_thread_info->get_thread_id());
     assert(s < num_slots_);
     return s;
   }
 
+  const size_t slots_per_thread_;
   std::unique_ptr<std::atomic<void *>[]> watches_;
   const size_t num_slots_;
 
+  /**
+   * A bitmap per thread of the unnamed slots that are currently reserved.
+   * Only the owning thread reads or writes its bitmap.
+   */
+  std::unique_ptr<PaddedAtomic<uint64_t>[]> free_slots_;
+
+  /**
+   * True if the process registered for expedited membarriers, in which case
+   * readers only need a compiler barrier. Initialized once, during static
+   * initialization, so it is never written while threads read it.
+   */
+  static const bool asymmetric_fence_;
+
  public:
   // Shared HP Element list manager
   util::memory::hp::ListManager hp_list_manager_;
@@ -222,6 +303,82 @@ class HazardPointer {
 };  // HazardPointer
 
 
+/**
+ * Reserves an unnamed hazard pointer slot for its lifetime. Any watch held in
+ * the slot is removed when the guard is reset or destroyed.
+ *
+ * Example:
+ *   HazardGuard head_guard, next_guard;
+ *   if (head_guard.watch(head, &head_, head) &&
+ *       next_guard.watch(next, &(head->next_), next)) { ... }
+ */
+class HazardGuard {
+ public:
+  explicit HazardGuard(HazardPointer * const hazard_pointer =
+        tervel::tl_thread_info->get_hazard_pointer())
+      : hazard_pointer_(hazard_pointer)
+      , slot_(hazard_pointer->acquire_slot()) {}
+
+  ~HazardGuard() {
+    reset();
+    hazard_pointer_->release_slot(slot_);
+  }
+
+  /**
+   * Watches elem, calling its on_watch function. See HazardPointer::watch.
+   * Any previous watch held by this guard is removed first.
+   *
+   * @return whether or not the watch was acquired.
+   */
+  bool watch(Element *elem, std::atomic<void *> *address, void *expected) {
+    reset();
+    if (HazardPointer::watch(slot_, elem, address, expected, hazard_pointer_)) {
+      elem_ = elem;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Watches value. See HazardPointer::watch.
+   * Any previous watch held by this guard is removed first.
+   *
+   * @return whether or not the watch was acquired.
+   */
+  bool watch(void *value, std::atomic<void *> *address, void *expected) {
+    reset();
+    return HazardPointer::watch(slot_, value, address, expected,
+          hazard_pointer_);
+  }
+
+  /**
+   * Removes the watch held by this guard, if any.
+   */
+  void reset() {
+    if (elem_ != nullptr) {
+      HazardPointer::unwatch(slot_, elem_, hazard_pointer_);
+      elem_ = nullptr;
+    } else if (HazardPointer::hasWatch(slot_, hazard_pointer_)) {
+      HazardPointer::unwatch(slot_, hazard_pointer_);
+    }
+  }
+
+  /**
+   * @return the slot reserved by this guard.
+   */
+  HazardPointer::SlotID slot() {
+    return slot_;
+  }
+
+ private:
+  HazardPointer * const hazard_pointer_;
+  const HazardPointer::SlotID slot_;
+  Element *elem_ {nullptr};
+
+  DISALLOW_COPY_AND_ASSIGN(HazardGuard);
+};  // HazardGuard
+
+
 }  // namespace hp
 }  // namespace memory
 }  // namepsace UTIL
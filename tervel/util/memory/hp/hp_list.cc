@@ -26,6 +26,7 @@ THE SOFTWARE.
 #include <tervel/util/memory/hp/list_manager.h>
 #include <tervel/util/memory/hp/hp_element.h>
 #include <tervel/util/memory/hp/hazard_pointer.h>
+#include <tervel/util/tervel_metrics.h>
 
 
 namespace tervel {
@@ -43,6 +44,9 @@ void ElementList::send_to_manager() {
 
 
 void ElementList::add_to_unsafe(Element* elem) {
+  #if tervel_track_hp_retired == tervel_track_enable
+    TERVEL_METRIC(hp_retired);
+  #endif
   elem->next(element_list_);
   element_list_ = elem;
 }
@@ -57,6 +61,9 @@ void ElementList::try_to_free_elements(bool dont_check) {
   #endif
 
   if (element_list_ != nullptr) {
+    if (!dont_check) {
+      HazardPointer::reclaimer_fence();
+    }
 
     Element *prev = element_list_;
     Element *temp = element_list_->next();
@@ -72,6 +79,9 @@ void ElementList::try_to_free_elements(bool dont_check) {
         #ifndef TERVEL_MEM_HP_NO_FREE
           delete temp;
         #endif
+        #if tervel_track_hp_reclaimed == tervel_track_enable
+          TERVEL_METRIC(hp_reclaimed);
+        #endif
         prev->next(temp_next);
         temp = temp_next;
       }
@@ -86,6 +96,9 @@ void ElementList::try_to_free_elements(bool dont_check) {
       #ifndef TERVEL_MEM_HP_NO_FREE
         delete element_list_;
       #endif
+      #if tervel_track_hp_reclaimed == tervel_track_enable
+        TERVEL_METRIC(hp_reclaimed);
+      #endif
       element_list_ = temp;
     }
   }
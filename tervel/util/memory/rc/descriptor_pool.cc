@@ -57,7 +57,7 @@ bool DescriptorPool::verify_pool_count(PoolElement *pool, uint64_t count) {
 
 void DescriptorPool::reserve(size_t num_descriptors) {
 
-  manager_->get_safe_elements(&safe_pool_, &safe_pool_count_,
+  manager_->get_safe_elements(numa_node_, &safe_pool_, &safe_pool_count_,
     num_descriptors);
 
   assert(verify_pool_count(safe_pool_, safe_pool_count_));
@@ -94,7 +94,8 @@ void DescriptorPool::offload() {
     assert(verify_pool_count(safe_pool_, safe_pool_count_));
     assert(verify_pool_count(extras, extra_count));
 
-    this->manager_->add_safe_elements(pool_id_, extras, tail);
+    this->manager_->add_safe_elements(numa_node_, extras, extra_count,
+        tail);
 
     #if tervel_track_rc_offload == tervel_track_enable
       TERVEL_METRIC(rc_offload);
@@ -109,7 +110,16 @@ PoolElement * DescriptorPool::get_from_pool(bool allocate_new) {
 #ifdef TERVEL_MEM_RC_NO_FREE
   return new PoolElement();
 #else
-  this->try_clear_unsafe_pool();
+  // The unsafe pool is only checked periodically, when it has grown large or
+  // when there is nothing left in the safe pool.
+  if (safe_pool_ == nullptr) {
+    scan_delay_ = TERVEL_MEM_RC_UNSAFE_SCAN_DELAY;
+    this->try_clear_unsafe_pool(false, true);
+  } else if (scan_delay_-- == 0 ||
+      unsafe_pool_count_ > TERVEL_MEM_RC_MAX_NODES) {
+    scan_delay_ = TERVEL_MEM_RC_UNSAFE_SCAN_DELAY;
+    this->try_clear_unsafe_pool();
+  }
 
   // First if local pool is empty go to global
   if (safe_pool_ == nullptr) {
@@ -148,7 +158,8 @@ PoolElement * DescriptorPool::get_from_pool(bool allocate_new) {
 void DescriptorPool::send_safe_to_manager() {
   if (safe_pool_ != nullptr) {
     assert(safe_pool_count_ > 0);
-    this->manager_->add_safe_elements(pool_id_, safe_pool_);
+    this->manager_->add_safe_elements(numa_node_, safe_pool_,
+        safe_pool_count_);
     safe_pool_count_ = 0;
     safe_pool_ = nullptr;
   }
@@ -156,7 +167,19 @@ void DescriptorPool::send_safe_to_manager() {
 
 
 void DescriptorPool::send_unsafe_to_manager() {
-  this->try_clear_unsafe_pool(false);
+  this->try_clear_unsafe_pool(false, true);
+
+  if (old_unsafe_pool_ != nullptr) {
+    PoolElement *tail = old_unsafe_pool_;
+    while (tail->next() != nullptr) {
+      tail = tail->next();
+    }
+    tail->next(unsafe_pool_);
+    unsafe_pool_ = old_unsafe_pool_;
+    unsafe_pool_count_ += old_unsafe_pool_count_;
+    old_unsafe_pool_ = nullptr;
+    old_unsafe_pool_count_ = 0;
+  }
 
   if (unsafe_pool_ != nullptr) {
     assert(unsafe_pool_count_ > 0);
@@ -192,41 +215,55 @@ void DescriptorPool::add_to_unsafe(tervel::util::Descriptor* descr) {
 }
 
 
-void DescriptorPool::try_clear_unsafe_pool(bool dont_check) {
-  if (unsafe_pool_ != nullptr) {
-    PoolElement *prev = unsafe_pool_;
-    PoolElement *temp = unsafe_pool_->next();
-
-    tervel::util::Descriptor *temp_descr;
-    while (temp) {
-      temp_descr = temp->descriptor();
-      PoolElement *temp_next = temp->next();
-
-      bool watched = is_watched(temp_descr);
-      if (!dont_check && watched) {
-        prev = temp;
-        temp = temp_next;
-      } else {
-        this->add_to_safe(temp_descr);
-        prev->next(temp_next);
-        temp = temp_next;
-        unsafe_pool_count_--;
-      }
-    }  // while temp
-
-    /**
-     * We check the first element last to allow for cleaner looping code.
-     */
-    temp = unsafe_pool_->next();
-    temp_descr = unsafe_pool_->descriptor();
-
-    bool watched = util::memory::rc::is_watched(temp_descr);
-    if (dont_check || !watched) {
-      unsafe_pool_count_--;
+void DescriptorPool::try_clear_unsafe_pool(bool dont_check, bool check_old) {
+  if (unsafe_pool_ == nullptr && old_unsafe_pool_ == nullptr) {
+    return;
+  }
+
+  uint64_t checked = 0;
+
+  if (check_old || old_scan_delay_-- == 0) {
+    old_scan_delay_ = TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY;
+    checked += clear_unsafe_list(&old_unsafe_pool_, &old_unsafe_pool_count_,
+        &old_unsafe_pool_, &old_unsafe_pool_count_, dont_check);
+  }
+
+  checked += clear_unsafe_list(&unsafe_pool_, &unsafe_pool_count_,
+      &old_unsafe_pool_, &old_unsafe_pool_count_, dont_check);
+
+  #if tervel_track_rc_unsafe_scan == tervel_track_enable
+    TERVEL_METRIC(rc_unsafe_scan)
+  #endif
+  #if tervel_track_rc_unsafe_scan_length == tervel_track_enable
+    TERVEL_METRIC_TRACK_VALUE(rc_unsafe_scan_length, checked)
+  #endif
+}
+
+
+uint64_t DescriptorPool::clear_unsafe_list(PoolElement **list,
+      uint64_t *count, PoolElement **keep, uint64_t *keep_count,
+      bool dont_check) {
+  PoolElement *temp = *list;
+  *list = nullptr;
+  *count = 0;
+
+  uint64_t checked = 0;
+  while (temp != nullptr) {
+    PoolElement *temp_next = temp->next();
+    tervel::util::Descriptor *temp_descr = temp->descriptor();
+    checked++;
+
+    if (!dont_check && is_watched(temp_descr)) {
+      temp->next(*keep);
+      *keep = temp;
+      (*keep_count)++;
+    } else {
       this->add_to_safe(temp_descr);
-      unsafe_pool_ = temp;
     }
-  }  // if unsafe_pool_
+    temp = temp_next;
+  }
+
+  return checked;
 }
 
 }  // namespace rc
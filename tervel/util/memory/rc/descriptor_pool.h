@@ -58,13 +58,17 @@ class PoolManager;
  */
 class DescriptorPool {
  public:
-  DescriptorPool(PoolManager *manager, uint64_t pool_id, int prefill = TERVEL_MEM_RC_MIN_NODES)
+  DescriptorPool(PoolManager *manager, uint64_t pool_id, size_t numa_node = 0,
+        int prefill = TERVEL_MEM_RC_MIN_NODES)
       : manager_(manager)
       , pool_id_(pool_id)
+      , numa_node_(numa_node)
       , safe_pool_{nullptr}
       , unsafe_pool_{nullptr}
+      , old_unsafe_pool_{nullptr}
       , safe_pool_count_(0)
-      , unsafe_pool_count_(0) {
+      , unsafe_pool_count_(0)
+      , old_unsafe_pool_count_(0) {
     this->reserve(prefill);
   }
   ~DescriptorPool() {
@@ -161,8 +165,22 @@ class DescriptorPool {
 
   /**
    * Try to move elements from the unsafe pool to the safe pool.
+   * Elements which are still watched are moved to the old unsafe pool, which
+   * is only checked once every TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY calls.
+   *
+   * @param dont_check If true, it ignores safety checks
+   * @param check_old If true, the old unsafe pool is always checked
+   */
+  void try_clear_unsafe_pool(bool dont_check = false, bool check_old = false);
+
+  /**
+   * Moves each element of list that is not watched to the safe pool and the
+   * rest to the front of keep. list and keep may be the same list.
+   *
+   * @return the number of elements that were checked
    */
-  void try_clear_unsafe_pool(bool dont_check = false);
+  uint64_t clear_unsafe_list(PoolElement **list, uint64_t *count,
+      PoolElement **keep, uint64_t *keep_count, bool dont_check);
 
   /** verifies that the length of the linked list matches the count
   */
@@ -177,10 +195,17 @@ class DescriptorPool {
   PoolManager *manager_;
 
   /**
-   * The pool where excess elements are placed
+   * The position in the manager where unsafe elements are placed when this
+   * pool is destroyed.
    */
   uint64_t pool_id_;
 
+  /**
+   * The NUMA node of the owning thread. Excess elements are given to this
+   * node's shared stack and refills prefer elements from it.
+   */
+  size_t numa_node_;
+
   /**
    * A linked list of pool elements.  One can be assured that no thread will try
    * to access the descriptor of any element in this pool. They can't be freed
@@ -198,11 +223,30 @@ class DescriptorPool {
   PoolElement *unsafe_pool_ {nullptr};
 
   /**
-   * Two counters used to track the number of elements in the linked list.
+   * A linked list of pool elements that were still watched the last time the
+   * unsafe pool was checked. Watches on these elements tend to be long lived,
+   * so they are checked less often.
+   */
+  PoolElement *old_unsafe_pool_ {nullptr};
+
+  /**
+   * Counters used to track the number of elements in the linked lists.
    * this facilitates the detection of when there are too many elements.
    */
   uint64_t safe_pool_count_ {0};
   uint64_t unsafe_pool_count_ {0};
+  uint64_t old_unsafe_pool_count_ {0};
+
+  /**
+   * The number of allocations until the unsafe pool is next checked.
+   */
+  uint64_t scan_delay_ {TERVEL_MEM_RC_UNSAFE_SCAN_DELAY};
+
+  /**
+   * The number of unsafe pool checks until the old unsafe pool is next
+   * checked.
+   */
+  uint64_t old_scan_delay_ {TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY};
 
   DISALLOW_COPY_AND_ASSIGN(DescriptorPool);
 };
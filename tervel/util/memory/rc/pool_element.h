@@ -25,6 +25,9 @@ THE SOFTWARE.
 #ifndef TERVEL_UTIL_MEMORY_RC_POOL_ELEMENT_H_
 #define TERVEL_UTIL_MEMORY_RC_POOL_ELEMENT_H_
 
+#include <stdlib.h>
+#include <new>
+
 #include <tervel/util/info.h>
 #include <tervel/util/util.h>
 #include <tervel/util/system.h>
@@ -42,6 +45,11 @@ const long DEBUG_EXPECTED_STAMP = 0xDEADBEEF;
  * a descriptor object. It is important to sepearte them to prevent the case
  * where a thread attempts to dereference an object while its type id is being
  * changed.
+ *
+ * By default the descriptor and the header share a single cache line. If
+ * TERVEL_MEM_RC_SPLIT_HEADER is defined the header is placed on a second cache
+ * line, so that watching threads updating ref_count do not invalidate the line
+ * the owning thread is writing the descriptor into.
  */
 class PoolElement {
  public:
@@ -61,6 +69,15 @@ class PoolElement {
 #endif
   };
 
+  /**
+   * The number of bytes available for a descriptor.
+   */
+#ifdef TERVEL_MEM_RC_SPLIT_HEADER
+  static constexpr size_t DESCRIPTOR_SPACE = CACHE_LINE_SIZE;
+#else
+  static constexpr size_t DESCRIPTOR_SPACE = CACHE_LINE_SIZE - sizeof(Header);
+#endif
+
   explicit PoolElement(PoolElement *next=nullptr) {
     this->header().next = next;
     assert(this->header().ref_count.load() == 0);
@@ -70,6 +87,22 @@ class PoolElement {
     assert(false && "PoolElement should never be deleted, return it to Tervel please");
   }
 
+  /**
+   * PoolElements are allocated on cache line boundaries, otherwise the
+   * descriptor and header could straddle lines shared with other elements.
+   */
+  static void * operator new(size_t size) {
+    void *mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, size) != 0) {
+      throw std::bad_alloc();
+    }
+    return mem;
+  }
+
+  static void operator delete(void *mem) {
+    free(mem);
+  }
+
   /**
    * @brief Returns a pointer to the associated descriptor of this element. This
    * pointer may or may not reference a constructed object.
@@ -117,14 +150,23 @@ class PoolElement {
    */
   void cleanup_descriptor();
  private:
-  char padding_[CACHE_LINE_SIZE - sizeof(Header)];
+  char padding_[DESCRIPTOR_SPACE];
   Header header_;
+#ifdef TERVEL_MEM_RC_SPLIT_HEADER
+  char header_padding_[CACHE_LINE_SIZE - sizeof(Header)];
+#endif
 
   DISALLOW_COPY_AND_ASSIGN(PoolElement);
 };
+#ifdef TERVEL_MEM_RC_SPLIT_HEADER
+static_assert(sizeof(PoolElement) == 2 * CACHE_LINE_SIZE,
+    "Pool elements should span two cache lines. Padding calculation is"
+    " probably wrong.");
+#else
 static_assert(sizeof(PoolElement) == CACHE_LINE_SIZE,
     "Pool elements should be cache-aligned. Padding calculation is probably"
     " wrong.");
+#endif
 
 /**
  * @brief If the given descriptor was allocated through a DescriptorPool, then it has
@@ -51,84 +51,141 @@ PoolManager::~PoolManager() {
       delete lst;
       lst = next;
     }
+  }
 
-    lst = pools_[i].safe_pool.exchange(nullptr);
+  for (size_t node = 0; node < number_nodes_; node++) {
+    PoolElement *lst = pop_batch(node);
     while (lst != nullptr) {
-      PoolElement *next = lst->next();
+      while (lst != nullptr) {
+        PoolElement *next = lst->next();
 
-      tervel::util::Descriptor *temp_descr;
-      temp_descr = lst->descriptor();
+        // The first element of a batch holds a BatchHeader instead of a
+        // destroyed descriptor, so only the reference count can be checked.
+        assert(lst->header().ref_count.load() == 0 &&
+          " memory is not being unwatched and it was in the safe list!...");
 
-      assert(!util::memory::rc::is_watched(temp_descr) &&
-        " memory is not being unwatched and it was in the safe list!...");
-
-      delete lst;
-      lst = next;
+        delete lst;
+        lst = next;
+      }
+      lst = pop_batch(node);
     }
-
   }
 }
 
-DescriptorPool * PoolManager::allocate_pool(const uint64_t pid) {
-  DescriptorPool *pool = new DescriptorPool(this, pid);
+DescriptorPool * PoolManager::allocate_pool(const uint64_t pid,
+    const size_t node) {
+  DescriptorPool *pool = new DescriptorPool(this, pid, node);
   return pool;
 }
 
 
-void PoolManager::get_safe_elements(PoolElement **pool, uint64_t *count, uint64_t min_elem) {
+PoolManager::BatchHeader * PoolManager::batch_header(PoolElement *elem) {
+  static_assert(sizeof(BatchHeader) <= PoolElement::DESCRIPTOR_SPACE,
+      "BatchHeader does not fit in the descriptor space of a PoolElement");
+  return reinterpret_cast<BatchHeader *>(elem->descriptor());
+}
+
+
+PoolElement * PoolManager::pop_batch(size_t node) {
+  assert(node < number_nodes_);
+  PaddedAtomic<uintptr_t> &safe_batches = safe_batches_[node];
+#if TERVEL_ADDRESS_TAG_BITS >= 16
+  uintptr_t head = safe_batches.load();
+  while (head_ptr(head) != nullptr) {
+    PoolElement *batch = head_ptr(head);
+    // batch may have been popped and reused since head was read, in which
+    // case the tag has changed and the CAS below fails.
+    PoolElement *next = batch_header(batch)->next_batch.load(
+        std::memory_order_relaxed);
+    if (safe_batches.compare_exchange_weak(head, next_head(head, next))) {
+      return batch;
+    }
+  }
+  return nullptr;
+#else
+  // Without an ABA tag the stack is taken as a whole, and the batches after
+  // the first are pushed back as a chain. Other threads may see the stack as
+  // empty meanwhile, in which case they allocate new elements.
+  PoolElement *batch = head_ptr(safe_batches.exchange(0));
+  if (batch == nullptr) {
+    return nullptr;
+  }
+  PoolElement *rest = batch_header(batch)->next_batch.load(
+      std::memory_order_relaxed);
+  if (rest != nullptr) {
+    PoolElement *last = rest;
+    PoolElement *next;
+    while ((next = batch_header(last)->next_batch.load(
+        std::memory_order_relaxed)) != nullptr) {
+      last = next;
+    }
+    uintptr_t head = safe_batches.load();
+    do {
+      batch_header(last)->next_batch.store(head_ptr(head),
+          std::memory_order_relaxed);
+    } while (!safe_batches.compare_exchange_weak(head, next_head(head, rest)));
+  }
+  return batch;
+#endif
+}
+
+
+void PoolManager::push_batch(size_t node, PoolElement *batch) {
+  assert(node < number_nodes_);
+  PaddedAtomic<uintptr_t> &safe_batches = safe_batches_[node];
+  BatchHeader *header = batch_header(batch);
+  uintptr_t head = safe_batches.load();
+  do {
+    header->next_batch.store(head_ptr(head), std::memory_order_relaxed);
+  } while (!safe_batches.compare_exchange_weak(head, next_head(head, batch)));
+}
+
+
+void PoolManager::get_safe_elements(size_t node, PoolElement **pool,
+    uint64_t *count, uint64_t min_elem) {
   assert(*pool == nullptr);
   assert(*count == 0);
 
-  for (size_t i = 0; i < number_pools_; i++) {
-    PoolElement *temp = pools_[i].safe_pool.load();
-    if (temp != nullptr) {
-      PoolElement *temp = pools_[i].safe_pool.exchange(nullptr);
+  // Start with the caller's node and only move on to other nodes once it has
+  // no batches left.
+  size_t i = 0;
+  while (*count < min_elem && i < number_nodes_) {
+    PoolElement *batch = pop_batch((node + i) % number_nodes_);
+    if (batch == nullptr) {
+      i++;
+      continue;
+    }
 
-      if (temp == nullptr) {
-        continue;
-      }
+    BatchHeader *header = batch_header(batch);
+    PoolElement *tail = header->tail;
+    *count += header->count;
+    header->~BatchHeader();
 
-      PoolElement *tail = temp;
-      (*count)++;
-      while (tail->next() != nullptr) {
-        (*count)++;
-        tail = tail->next();
-      }
-      tail->next(*pool);
-      *pool = temp;
-
-      if (*count >= min_elem) {
-        #ifdef tervel_track_rc_get_manager
-          util::EventTracker::countEvent(util::EventTracker::event_code::rc_get_manager);
-        #endif
-        break;
-      }
-    }
-  }  // for
+    tail->next(*pool);
+    *pool = batch;
+  }
 }
 
 
 
-void PoolManager::add_safe_elements(uint64_t pid, PoolElement *pool, PoolElement *pool_end) {
+void PoolManager::add_safe_elements(size_t node, PoolElement *pool,
+    uint64_t count, PoolElement *pool_end) {
   assert(pool != nullptr);
+  assert(count > 0);
 
-  PoolElement * temp = pools_[pid].safe_pool.load();
-  if (temp != nullptr) {
-    temp = pools_[pid].safe_pool.exchange(nullptr);
-    if (temp != nullptr) {
-      if (pool_end == nullptr) {
-        pool_end = pool;
-        while (pool_end->next() != nullptr) {
-          pool_end = pool_end->next();
-        }
-      }
-      assert(pool_end != nullptr);
-      pool_end->next(temp);
+  if (pool_end == nullptr) {
+    pool_end = pool;
+    while (pool_end->next() != nullptr) {
+      pool_end = pool_end->next();
     }
   }
-  assert(pools_[pid].safe_pool.load() == nullptr);
-  pools_[pid].safe_pool.store(pool);
-  pool = nullptr;
+  assert(pool_end->next() == nullptr);
+
+  BatchHeader *header = new(batch_header(pool)) BatchHeader();
+  header->tail = pool_end;
+  header->count = count;
+
+  push_batch(node, pool);
 }
 
 void PoolManager::add_unsafe_elements(uint64_t pid, PoolElement *pool) {
@@ -29,6 +29,9 @@ THE SOFTWARE.
 #include <tervel/util/info.h>
 #include <tervel/util/util.h>
 #include <tervel/util/system.h>
+#include <tervel/util/padded_atomic.h>
+#include <tervel/util/tagged_ptr.h>
+#include <tervel/util/numa.h>
 // #include <tervel/util/descriptor.h>
 // #include <tervel/util/memory/rc/descriptor_pool.h>
 // #include <tervel/util/memory/rc/descriptor_util.h>
@@ -50,6 +53,12 @@ class PoolElement;
  * pool in this manager, or can take elements from the shared pools in this
  * manager.
  *
+ * Safe elements are exchanged as batches through a lock-free stack per NUMA
+ * node. The number of elements in a batch and its last element are stored in a
+ * BatchHeader placed in the unused descriptor space of the batch's first
+ * element, so taking or giving a batch is a single CAS and never requires
+ * walking the list. A thread gives batches to the stack of its own node and
+ * only takes batches from other nodes when its own node's stack is empty.
  */
 class PoolManager {
  public:
@@ -63,7 +72,13 @@ class PoolManager {
    */
   explicit PoolManager(size_t number_pools)
       : number_pools_(number_pools)
-      , pools_(new ManagedPool[number_pools]()) {}
+      , number_nodes_(numa::num_nodes())
+      , safe_batches_(new PaddedAtomic<uintptr_t>[number_nodes_])
+      , pools_(new ManagedPool[number_pools]()) {
+    for (size_t i = 0; i < number_nodes_; i++) {
+      safe_batches_[i].store(0);
+    }
+  }
 
   ~PoolManager();
 
@@ -76,35 +91,39 @@ class PoolManager {
    * that object
    *
    * @param tid Tervel thread id for the calling thread
+   * @param node NUMA node of the calling thread
    * @return a DescriptorPool pointer
    */
-  DescriptorPool * allocate_pool(const uint64_t tid);
+  DescriptorPool * allocate_pool(const uint64_t tid, const size_t node = 0);
 
   /**
    * @brief This fuinction attempts to get 'count' many elements from the global
    * pool
-   * @details A thread calling this function attempts to take any free elements
-   * and if successful will update the pool list, and count.
-   * It will keep trying until count >= min_elem or there are no more elements
-   * that can be taken from the global pool.
+   * @details A thread calling this function pops batches from the shared
+   * stacks and prepends them to pool, updating count from each batch's header.
+   * It will keep popping until count >= min_elem or all stacks are empty.
+   * The stack of the caller's node is used first.
    *
+   * @param node The NUMA node of the calling thread
    * @param pool A link list to pre-pend any elements taken from the global pool
    * @param count A count of the number of elements in pool
    * @param min_elem The min desired value of count
    */
-  void get_safe_elements(PoolElement **pool, uint64_t *count, uint64_t min_elem);
+  void get_safe_elements(size_t node, PoolElement **pool, uint64_t *count,
+    uint64_t min_elem);
 
   /**
    * @brief Places excess elements into the global pool
-   * @details Places excess elements into the global pool by performing an
-   * exchange on the current value of at position 'pid' then combing it was
-   * the excess elements and then storing the new value.
+   * @details Turns the list into a batch by writing its header into the first
+   * element and then pushes it onto the shared stack of the specified node.
    *
-   * @param pid the position to add the elements
-   * @param pool the elements to end
-   * @param pool_end a shortcut to the end of the pool list
+   * @param node The NUMA node of the calling thread
+   * @param pool the elements to send
+   * @param count the number of elements in pool
+   * @param pool_end a shortcut to the end of the pool list, if nullptr the
+   * list is walked to find it.
    */
-  void add_safe_elements(uint64_t pid, PoolElement *pool,
+  void add_safe_elements(size_t node, PoolElement *pool, uint64_t count,
     PoolElement *pool_end = nullptr);
 
   /**
@@ -120,20 +139,88 @@ class PoolManager {
 
   const size_t number_pools_;
 
+  /**
+   * The number of NUMA nodes, there is one shared stack per node.
+   */
+  const size_t number_nodes_;
+
  private:
+  /**
+   * Stored in the descriptor space of the first element of a batch while the
+   * batch is on the shared stack. Elements in the safe pool never hold a
+   * constructed descriptor, so this space is free to use.
+   */
+  struct BatchHeader {
+    std::atomic<PoolElement *> next_batch;
+    PoolElement *tail;
+    uint64_t count;
+  };
+
+  /**
+   * @return the BatchHeader stored in elem.
+   */
+  static BatchHeader * batch_header(PoolElement *elem);
+
+  /**
+   * Where the upper address bits are unused, the head of the shared stack is
+   * a PoolElement pointer with an ABA tag in those bits, which is incremented
+   * on every successful push and pop. Elsewhere the head is a plain pointer
+   * and pop_batch takes the whole stack with an exchange, which is not
+   * subject to ABA.
+   */
+#if TERVEL_ADDRESS_TAG_BITS >= 16
+  typedef TaggedPtr<PoolElement, HighTag<16>> BatchHead;
+
+  static PoolElement * head_ptr(uintptr_t head) {
+    return BatchHead::from_raw(head).ptr();
+  }
+
+  static uintptr_t next_head(uintptr_t head, PoolElement *ptr) {
+    return BatchHead::from_raw(head).with_ptr(ptr).next_tag<0>().raw();
+  }
+#else
+  static PoolElement * head_ptr(uintptr_t head) {
+    return reinterpret_cast<PoolElement *>(head);
+  }
+
+  static uintptr_t next_head(uintptr_t head, PoolElement *ptr) {
+    (void)head;
+    return reinterpret_cast<uintptr_t>(ptr);
+  }
+#endif
+
+  /**
+   * Pops a single batch from the shared stack of the specified node.
+   * @return the first element of the batch or nullptr if the stack is empty.
+   */
+  PoolElement * pop_batch(size_t node);
+
+  /**
+   * Pushes a batch whose header has been initialized onto the shared stack of
+   * the specified node.
+   */
+  void push_batch(size_t node, PoolElement *batch);
+
+  /**
+   * Only used to hold the unsafe elements of detached threads, which are freed
+   * when the manager is destroyed.
+   */
   struct ManagedPool {
-    std::atomic<PoolElement *> safe_pool;
     std::atomic<PoolElement *> unsafe_pool;
 
-    char padding[CACHE_LINE_SIZE  - sizeof(safe_pool) - sizeof(unsafe_pool)];
+    char padding[CACHE_LINE_SIZE - sizeof(unsafe_pool)];
     void operator()() {
-      safe_pool.store(nullptr);
       unsafe_pool.store(nullptr);
     }
   };
   static_assert(sizeof(ManagedPool) == CACHE_LINE_SIZE,
       "Managed pools have to be cache aligned to prevent false sharing.");
 
+  /**
+   * The tagged heads of the shared stacks of safe batches, one per node.
+   */
+  std::unique_ptr<PaddedAtomic<uintptr_t>[]> safe_batches_;
+
   std::unique_ptr<ManagedPool[]> pools_;
 
   DISALLOW_COPY_AND_ASSIGN(PoolManager);
@@ -0,0 +1,168 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <tervel/util/metrics_exporter.h>
+#include <tervel/util/tervel.h>
+#include <tervel/util/tervel_metrics.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace tervel {
+namespace util {
+
+MetricsExporter::MetricsExporter(Tervel *tervel, const std::string &path,
+      Format format, Target target, uint64_t interval_ms)
+    : tervel_(tervel)
+    , path_(path)
+    , format_(format)
+    , target_(target)
+    , interval_ms_(interval_ms) {}
+
+void MetricsExporter::start() {
+  if (running_.exchange(true)) {
+    return;
+  }
+  thread_ = std::thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_.exchange(false)) {
+      return;
+    }
+  }
+  stop_cv_.notify_all();
+  thread_.join();
+  export_now();
+}
+
+void MetricsExporter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_.load()) {
+    lock.unlock();
+    export_now();
+    lock.lock();
+    stop_cv_.wait_for(lock, std::chrono::milliseconds(interval_ms_),
+        [this] { return !running_.load(); });
+  }
+}
+
+std::string MetricsExporter::render() {
+  std::vector<std::unique_ptr<EventTracker>> snapshots;
+  tervel_->snapshot_metrics(&snapshots);
+
+  if (format_ == Format::PROMETHEUS) {
+    return EventTracker::generatePrometheus(snapshots);
+  }
+
+  uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  EventTracker totals;
+  std::string threads = "";
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    if (snapshots[i] == nullptr) {
+      continue;
+    }
+    totals.add(snapshots[i].get());
+    if (!threads.empty()) {
+      threads += ", ";
+    }
+    threads += snapshots[i]->generateJson(i);
+  }
+  return "{\"timestamp_ms\": " + std::to_string(now_ms) +
+      ", \"totals\": " + totals.generateJson() +
+      ", \"threads\": [" + threads + "]}\n";
+}
+
+bool MetricsExporter::export_now() {
+  const std::string data = render();
+  if (target_ == Target::FILE) {
+    return write_file(data);
+  } else {
+    return write_socket(data);
+  }
+}
+
+bool MetricsExporter::write_file(const std::string &data) {
+  // Readers must never see a partial file, so it is replaced by a rename.
+  const std::string temp_path = path_ + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  bool res = fwrite(data.data(), 1, data.size(), file) == data.size();
+  // Flushed to disk before the rename, so that after a crash path holds
+  // either the previous or the new metrics.
+  res = res && fflush(file) == 0 && fsync(fileno(file)) == 0;
+  res = (fclose(file) == 0) && res;
+  if (!res) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return rename(temp_path.c_str(), path_.c_str()) == 0;
+}
+
+bool MetricsExporter::write_socket(const std::string &data) {
+  struct sockaddr_un addr;
+  if (path_.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+        sizeof(addr)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t res = send(fd, data.data() + written, data.size() - written,
+        MSG_NOSIGNAL);
+    if (res <= 0) {
+      break;
+    }
+    written += res;
+  }
+  close(fd);
+  return written == data.size();
+}
+
+}  // namespace util
+}  // namespace tervel
@@ -0,0 +1,116 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_UTIL_METRICS_EXPORTER_H_
+#define TERVEL_UTIL_METRICS_EXPORTER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <tervel/util/util.h>
+
+namespace tervel {
+class Tervel;
+
+namespace util {
+
+/**
+ * Periodically writes a snapshot of a Tervel object's metrics, so that
+ * monitoring can follow them while the process runs.
+ *
+ * Every interval the exporter takes a snapshot of each thread's EventTracker,
+ * which does not stop the threads, and renders it in the Prometheus text
+ * exposition format or as JSON. It then either replaces a file, by writing
+ * to a temporary file and renaming it, or connects to a UNIX stream socket
+ * and writes the snapshot to it. A failed write is skipped until the next
+ * interval.
+ *
+ * Metrics are only collected when built with USE_TERVEL_METRICS.
+ */
+class MetricsExporter {
+ public:
+  enum class Format {PROMETHEUS, JSON};
+  enum class Target {FILE, UNIX_SOCKET};
+
+  /**
+   * @param tervel the Tervel object whose metrics are exported
+   * @param path the file to replace or the socket to connect to
+   * @param format the output format
+   * @param target whether path is a file or a socket
+   * @param interval_ms the time between exports
+   */
+  MetricsExporter(Tervel *tervel, const std::string &path,
+        Format format = Format::PROMETHEUS, Target target = Target::FILE,
+        uint64_t interval_ms = TERVEL_METRIC_EXPORT_INTERVAL_MS);
+
+  ~MetricsExporter() { stop(); }
+
+  /**
+   * Starts the background thread, which exports immediately and then once
+   * every interval.
+   */
+  void start();
+
+  /**
+   * Stops the background thread after a final export.
+   */
+  void stop();
+
+  /**
+   * @return the current metrics in the exporter's format
+   */
+  std::string render();
+
+  /**
+   * Exports the current metrics once.
+   * @return whether or not the write succeeded
+   */
+  bool export_now();
+
+ private:
+  void run();
+  bool write_file(const std::string &data);
+  bool write_socket(const std::string &data);
+
+  Tervel * const tervel_;
+  const std::string path_;
+  const Format format_;
+  const Target target_;
+  const uint64_t interval_ms_;
+
+  std::atomic<bool> running_ {false};
+  std::mutex mutex_;
+  std::condition_variable stop_cv_;
+  std::thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricsExporter);
+};
+
+}  // namespace util
+}  // namespace tervel
+
+#endif  // TERVEL_UTIL_METRICS_EXPORTER_H_
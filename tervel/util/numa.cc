@@ -0,0 +1,82 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <tervel/util/numa.h>
+
+#include <fstream>
+#include <string>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace tervel {
+namespace util {
+namespace numa {
+
+size_t num_nodes() {
+#ifdef TERVEL_NO_NUMA
+  return 1;
+#else
+  static const size_t nodes = [] () -> size_t {
+    // The file contains a range list such as "0" or "0-3" or "0,2".
+    std::ifstream file("/sys/devices/system/node/possible");
+    std::string line;
+    if (!std::getline(file, line)) {
+      return 1;
+    }
+
+    size_t max_node = 0;
+    size_t value = 0;
+    for (char c : line) {
+      if (c >= '0' && c <= '9') {
+        value = value * 10 + (c - '0');
+        if (value > max_node) {
+          max_node = value;
+        }
+      } else {
+        value = 0;
+      }
+    }
+    return max_node + 1;
+  }();
+  return nodes;
+#endif
+}
+
+size_t current_node() {
+#if defined(TERVEL_NO_NUMA) || !defined(SYS_getcpu)
+  return 0;
+#else
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 || node >= num_nodes()) {
+    return 0;
+  }
+  return node;
+#endif
+}
+
+}  // namespace numa
+}  // namespace util
+}  // namespace tervel
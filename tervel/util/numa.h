@@ -0,0 +1,61 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_UTIL_NUMA_H_
+#define TERVEL_UTIL_NUMA_H_
+/**
+ * Helpers for discovering the NUMA topology of the machine without depending
+ * on libnuma. The node count is read from sysfs and the node of the calling
+ * thread is found with the getcpu system call.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tervel {
+namespace util {
+namespace numa {
+
+// #define TERVEL_NO_NUMA
+  // causes every thread to be reported as running on node 0, which disables
+  // node-local reuse of descriptors.
+
+/**
+ * @return the number of NUMA nodes the kernel may report. Node ids returned by
+ * current_node() are always less than this value. Returns 1 if the topology
+ * can not be determined.
+ */
+size_t num_nodes();
+
+/**
+ * @return the NUMA node the calling thread is currently running on, or 0 if it
+ * can not be determined. A thread may migrate, so this is only a hint.
+ */
+size_t current_node();
+
+}  // namespace numa
+}  // namespace util
+}  // namespace tervel
+
+#endif  // TERVEL_UTIL_NUMA_H_
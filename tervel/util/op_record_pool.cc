@@ -0,0 +1,115 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <tervel/util/op_record_pool.h>
+#include <tervel/util/system.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <new>
+
+namespace tervel {
+namespace util {
+
+namespace {
+// The size of the smallest class, as a size_t so shifts of it compare
+// cleanly against requested sizes.
+const size_t kLineSize = CACHE_LINE_SIZE;
+}  // namespace
+
+OpRecordPool::OpRecordPool(size_t prefill) {
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    free_list_[i] = nullptr;
+    count_[i] = 0;
+    for (size_t j = 0; j < prefill; j++) {
+      this->free(allocate_block(kLineSize << i), kLineSize << i);
+    }
+  }
+}
+
+OpRecordPool::~OpRecordPool() {
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    Block *block = free_list_[i];
+    while (block != nullptr) {
+      Block *next = block->next;
+      free_block(block);
+      block = next;
+    }
+  }
+}
+
+void * OpRecordPool::allocate(size_t size) {
+  size_t i = size_class(size);
+  if (i == NUM_CLASSES || free_list_[i] == nullptr) {
+    return allocate_block(size);
+  }
+
+  Block *block = free_list_[i];
+  free_list_[i] = block->next;
+  count_[i]--;
+  return block;
+}
+
+void OpRecordPool::free(void *ptr, size_t size) {
+  size_t i = size_class(size);
+  if (i == NUM_CLASSES || count_[i] >= TERVEL_OP_RECORD_POOL_MAX) {
+    free_block(ptr);
+    return;
+  }
+
+  Block *block = reinterpret_cast<Block *>(ptr);
+  block->next = free_list_[i];
+  free_list_[i] = block;
+  count_[i]++;
+}
+
+void * OpRecordPool::allocate_block(size_t size) {
+  size_t i = size_class(size);
+  if (i != NUM_CLASSES) {
+    // Blocks are allocated with the size of their class so that they can be
+    // reused for any record of that class.
+    size = kLineSize << i;
+  }
+
+  void *ptr;
+  if (posix_memalign(&ptr, CACHE_LINE_SIZE, size) != 0) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void OpRecordPool::free_block(void *ptr) {
+  ::free(ptr);
+}
+
+size_t OpRecordPool::size_class(size_t size) {
+  size_t i = 0;
+  while (i < NUM_CLASSES && (kLineSize << i) < size) {
+    i++;
+  }
+  return i;
+}
+
+}  // namespace util
+}  // namespace tervel
@@ -0,0 +1,110 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_UTIL_OP_RECORD_POOL_H_
+#define TERVEL_UTIL_OP_RECORD_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tervel/util/util.h>
+
+namespace tervel {
+namespace util {
+
+/**
+ * A thread local cache of memory blocks for OpRecords.
+ *
+ * OpRecords are only created once an operation has failed to complete, so
+ * allocating them with malloc puts an allocator call on the path of a thread
+ * that is already starved. OpRecord overrides new and delete to take blocks
+ * from and return blocks to the calling thread's pool instead. The hazard
+ * pointer scheme still decides when an OpRecord is deleted.
+ *
+ * Blocks are cache line aligned and come in a few size classes. Records
+ * larger than the largest class are allocated directly. A block may be freed
+ * by a different thread than the one that allocated it, in which case it
+ * simply joins the freeing thread's pool.
+ */
+class OpRecordPool {
+ public:
+  /**
+   * The number of size classes, class i holds blocks of
+   * CACHE_LINE_SIZE << i bytes.
+   */
+  static constexpr size_t NUM_CLASSES = 4;
+
+  /**
+   * @param prefill the number of blocks to allocate for each size class.
+   */
+  explicit OpRecordPool(size_t prefill = TERVEL_OP_RECORD_POOL_PREFILL);
+
+  ~OpRecordPool();
+
+  /**
+   * @param size the size of the record
+   * @return a block of at least size bytes
+   */
+  void * allocate(size_t size);
+
+  /**
+   * Returns a block to the pool, or frees it if the pool already holds
+   * TERVEL_OP_RECORD_POOL_MAX blocks of its class.
+   *
+   * @param ptr a block returned by allocate or allocate_block
+   * @param size the size that was requested for it
+   */
+  void free(void *ptr, size_t size);
+
+  /**
+   * Allocates a block with the layout used by the pool, for threads which do
+   * not have a pool.
+   */
+  static void * allocate_block(size_t size);
+
+  /**
+   * Frees a block without a pool.
+   */
+  static void free_block(void *ptr);
+
+ private:
+  struct Block {
+    Block *next;
+  };
+
+  /**
+   * @return the size class of size, or NUM_CLASSES if it is too large.
+   */
+  static size_t size_class(size_t size);
+
+  Block *free_list_[NUM_CLASSES];
+  size_t count_[NUM_CLASSES];
+
+  DISALLOW_COPY_AND_ASSIGN(OpRecordPool);
+};
+
+}  // namespace util
+}  // namespace tervel
+
+#endif  // TERVEL_UTIL_OP_RECORD_POOL_H_
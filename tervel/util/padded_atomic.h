@@ -77,6 +77,16 @@ class PaddedAtomic {
     return atomic.fetch_add(arg, memory_order);
   }
 
+  T fetch_or(T arg, std::memory_order memory_order =
+        std::memory_order_seq_cst ) {
+    return atomic.fetch_or(arg, memory_order);
+  }
+
+  T fetch_and(T arg, std::memory_order memory_order =
+        std::memory_order_seq_cst ) {
+    return atomic.fetch_and(arg, memory_order);
+  }
+
   std::atomic<T> atomic;
 
  private:
@@ -23,22 +23,118 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 #include <tervel/util/progress_assurance.h>
+#include <tervel/util/op_record_pool.h>
 #include <tervel/util/memory/hp/hazard_pointer.h>
 
 
 namespace tervel {
 namespace util {
 
+void * OpRecord::operator new(size_t size) {
+  if (tervel::tl_thread_info == nullptr) {
+    return OpRecordPool::allocate_block(size);
+  }
+  return tervel::tl_thread_info->get_op_record_pool()->allocate(size);
+}
+
+void OpRecord::operator delete(void *ptr, size_t size) {
+  // The hazard pointer list manager may free records after the threads which
+  // retired them have detached.
+  if (tervel::tl_thread_info == nullptr) {
+    OpRecordPool::free_block(ptr);
+  } else {
+    tervel::tl_thread_info->get_op_record_pool()->free(ptr, size);
+  }
+}
+
+void ProgressSettings::on_announcement() {
+  if (!adaptive()) {
+    return;
+  }
+  uint64_t count = announced_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (count < TERVEL_PROG_ASSUR_ADAPT_PERIOD ||
+      !announced_.compare_exchange_strong(count, 0)) {
+    return;
+  }
+  uint64_t helped = helped_.exchange(0);
+
+  if (helped > count * 2) {
+    adapt(&limit_, base_limit_.load(std::memory_order_relaxed), true);
+    adapt(&help_delay_, base_help_delay_.load(std::memory_order_relaxed),
+          true);
+  } else if (helped * 4 < count) {
+    adapt(&limit_, base_limit_.load(std::memory_order_relaxed), false);
+    adapt(&help_delay_, base_help_delay_.load(std::memory_order_relaxed),
+          false);
+  }
+}
+
+void ProgressSettings::adapt(std::atomic<int64_t> *value, int64_t base,
+      bool raise) {
+  if (base <= 0) {
+    // Disabled or always on, there is nothing to adapt.
+    return;
+  }
+  const int64_t range = TERVEL_PROG_ASSUR_ADAPT_RANGE;
+  const int64_t max = base * range;
+  const int64_t min = base / range > 0 ? base / range : 1;
+
+  int64_t cur = value->load(std::memory_order_relaxed);
+  int64_t next = raise ? cur * 2 : cur / 2;
+  if (next > max) {
+    next = max;
+  } else if (next < min) {
+    next = min;
+  }
+  value->store(next, std::memory_order_relaxed);
+}
+
 void ProgressAssurance::p_check_for_announcement(int64_t &help_id) {
-    help_id++;
-    if (help_id >= num_threads_) {
-      help_id = 0;
+#ifdef TERVEL_PROG_ASSUR_HELP_ALL
+  for (int64_t w = 0; w < num_words_; w++) {
+    uint64_t bits = announced_[w].load();
+    while (bits != 0) {
+      help(w * 64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+#else
+  int64_t id = next_announced(help_id);
+  if (id != -1) {
+    help_id = id;
+    help(id);
+  }
+#endif
+}
+
+int64_t ProgressAssurance::next_announced(int64_t after) {
+  int64_t start = after + 1;
+  if (start >= num_threads_) {
+    start = 0;
+  }
+
+  // The first word is checked twice, once for the bits after start and once,
+  // after wrapping around, for the bits before it.
+  int64_t word = start / 64;
+  uint64_t bits = announced_[word].load() & (~0ULL << (start % 64));
+  for (int64_t i = 0; i <= num_words_; i++) {
+    if (bits != 0) {
+      return word * 64 + __builtin_ctzll(bits);
     }
+    word++;
+    if (word == num_words_) {
+      word = 0;
+    }
+    bits = announced_[word].load();
+  }
+  return -1;
+}
 
-    OpRecord *op = op_table_[help_id].load();
+void ProgressAssurance::help(int64_t id) {
+    OpRecord *op = op_table_[id].load();
     if (op != nullptr) {
       std::atomic<void *> *address = reinterpret_cast<std::atomic<void *> *>(
-              &(op_table_[help_id]));
+              &(op_table_[id].atomic));
 
       typedef memory::hp::HazardPointer::SlotID SlotID;
       SlotID pos = SlotID::PROG_ASSUR;
@@ -46,6 +142,9 @@ void ProgressAssurance::p_check_for_announcement(int64_t &help_id) {
       if (res) {
         assert(memory::hp::HazardPointer::is_watched(op));
         op->help_complete();
+        if (op->prog_settings_ != nullptr) {
+          op->prog_settings_->on_help();
+        }
         #if tervel_track_helped_announcement == tervel_track_enable
         TERVEL_METRIC(helped_announcement);
         #endif
@@ -54,10 +153,18 @@ void ProgressAssurance::p_check_for_announcement(int64_t &help_id) {
     }
 }
 
-void ProgressAssurance::p_make_announcement(OpRecord *op, const uint64_t tid) {
+void ProgressAssurance::p_make_announcement(OpRecord *op, const uint64_t tid,
+      ProgressSettings *settings) {
+  if (settings->adaptive()) {
+    op->prog_settings_ = settings;
+    settings->on_announcement();
+  }
+  const uint64_t bit = 1ULL << (tid % 64);
   op_table_[tid].store(op);
+  announced_[tid / 64].fetch_or(bit);
   op->help_complete();
   op_table_[tid].store(nullptr);
+  announced_[tid / 64].fetch_and(~bit);
 }
 
 }  // namespace memory
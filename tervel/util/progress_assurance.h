@@ -30,6 +30,7 @@ THE SOFTWARE.
 #include <assert.h>
 #include <tervel/util/info.h>
 #include <tervel/util/util.h>
+#include <tervel/util/padded_atomic.h>
 #include <tervel/util/memory/hp/hp_element.h>
 #include <tervel/util/tervel_metrics.h>
 
@@ -43,6 +44,101 @@ namespace hp {
 }
 }
 
+/**
+ * This class holds the progress assurance parameters used by a set of
+ * operations. The Tervel object holds the default instance, containers may
+ * hold their own to override it.
+ *
+ * limit is the number of failed attempts before an operation is announced and
+ * help_delay is the number of calls to check_for_announcement between checks
+ * of the announcement table.
+ *
+ * In adaptive mode, after every TERVEL_PROG_ASSUR_ADAPT_PERIOD announcements
+ * the number of times announced operations were helped is compared to the
+ * number of announcements. If operations are helped by several threads, the
+ * announcements are pulling too many threads into the slow path, and both
+ * values are doubled. If announced operations are rarely helped, announcing is
+ * cheap and both values are halved, which lowers the latency of a starved
+ * operation. Both values stay within TERVEL_PROG_ASSUR_ADAPT_RANGE of the
+ * values last set.
+ */
+class ProgressSettings {
+ public:
+  explicit ProgressSettings(int64_t limit = TERVEL_PROG_ASSUR_LIMIT,
+        int64_t help_delay = TERVEL_PROG_ASSUR_DELAY,
+        bool adaptive = TERVEL_PROG_ASSUR_ADAPTIVE_DEFAULT)
+      : limit_(limit)
+      , help_delay_(help_delay)
+      , base_limit_(limit)
+      , base_help_delay_(help_delay)
+      , adaptive_(adaptive)
+      , announced_(0)
+      , helped_(0) {}
+
+  int64_t limit() const { return limit_.load(std::memory_order_relaxed); }
+  int64_t help_delay() const {
+    return help_delay_.load(std::memory_order_relaxed);
+  }
+  bool adaptive() const { return adaptive_.load(std::memory_order_relaxed); }
+
+  /**
+   * Sets the limit, a negative value disables announcements.
+   * In adaptive mode this is also the value that is adapted from.
+   */
+  void set_limit(int64_t limit) {
+    base_limit_.store(limit, std::memory_order_relaxed);
+    limit_.store(limit, std::memory_order_relaxed);
+  }
+
+  /**
+   * Sets the help delay, a negative value disables checking for
+   * announcements once the current delay expires.
+   * In adaptive mode this is also the value that is adapted from.
+   */
+  void set_help_delay(int64_t help_delay) {
+    base_help_delay_.store(help_delay, std::memory_order_relaxed);
+    help_delay_.store(help_delay, std::memory_order_relaxed);
+  }
+
+  void set_adaptive(bool adaptive) {
+    adaptive_.store(adaptive, std::memory_order_relaxed);
+  }
+
+  /**
+   * Called when an operation using these settings is announced.
+   */
+  void on_announcement();
+
+  /**
+   * Called when a thread helps an operation announced with these settings.
+   */
+  void on_help() {
+    helped_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  /**
+   * Adjusts a value based on the help ratio of the last period.
+   * @param value the value to adjust
+   * @param base the value last set by the user
+   * @param raise whether to raise or lower the value
+   */
+  static void adapt(std::atomic<int64_t> *value, int64_t base, bool raise);
+
+  std::atomic<int64_t> limit_;
+  std::atomic<int64_t> help_delay_;
+  std::atomic<int64_t> base_limit_;
+  std::atomic<int64_t> base_help_delay_;
+  std::atomic<bool> adaptive_;
+
+  // Counters for the current adaptive period
+  std::atomic<uint64_t> announced_;
+  std::atomic<uint64_t> helped_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProgressSettings);
+};
+
+
 /**
  * This class is used to create Operation Records.
  * Operation records are designed to allow an arbitary thread to complete
@@ -54,6 +150,13 @@ class OpRecord : public memory::hp::Element {
  public:
   OpRecord() {}
 
+  /**
+   * OpRecords are allocated from the calling thread's OpRecordPool, so that
+   * announcing an operation does not call malloc.
+   */
+  static void * operator new(size_t size);
+  static void operator delete(void *ptr, size_t size);
+
   /**
    * Implementations of this function that upon its return the operation
    * described in the OpRecord has been completed.
@@ -92,6 +195,14 @@ class OpRecord : public memory::hp::Element {
 
 
  private:
+  friend class ProgressAssurance;
+
+  /**
+   * The settings the operation was announced with, set only if they are
+   * adaptive so that helping threads can report that they helped.
+   */
+  ProgressSettings *prog_settings_ {nullptr};
+
   DISALLOW_COPY_AND_ASSIGN(OpRecord);
 };
 
@@ -113,14 +224,21 @@ class ProgressAssurance {
 
   /**
    * Const used to reduce the number of times a thread checks the table
-   * Reduces memory loads at the cost of a higher upper bound
+   * Reduces memory loads at the cost of a higher upper bound.
+   * This is the initial delay, afterwards ProgressSettings::help_delay is used.
    */
   static constexpr int64_t HELP_DELAY = TERVEL_PROG_ASSUR_DELAY;
 
 
   class Limit {
    public:
-    explicit Limit(int64_t limit = TERVEL_PROG_ASSUR_LIMIT)
+    /**
+     * Uses the limit of settings, or of the Tervel object if it is nullptr.
+     */
+    explicit Limit(ProgressSettings *settings = nullptr)
+      : counter_(get_settings(settings)->limit()) {}
+
+    explicit Limit(int64_t limit)
       : counter_(limit) {}
 
     ~Limit() {
@@ -149,7 +267,11 @@ class ProgressAssurance {
         }
     }
 
-    void reset(int64_t limit = TERVEL_PROG_ASSUR_LIMIT) {
+    void reset(ProgressSettings *settings = nullptr) {
+      counter_ = get_settings(settings)->limit();
+    }
+
+    void reset(int64_t limit) {
       counter_ = limit;
     }
    private:
@@ -157,8 +279,33 @@ class ProgressAssurance {
   };
 
   explicit ProgressAssurance(int64_t num_threads)
-      : op_table_(new std::atomic<OpRecord *>[num_threads]() )
-      , num_threads_ {num_threads} {}
+      : op_table_(new PaddedAtomic<OpRecord *>[num_threads]())
+      , num_threads_ {num_threads}
+      , num_words_ {(num_threads + 63) / 64}
+      , announced_(new PaddedAtomic<uint64_t>[num_words_]()) {
+    for (int64_t i = 0; i < num_threads_; i++) {
+      op_table_[i].store(nullptr);
+    }
+    for (int64_t i = 0; i < num_words_; i++) {
+      announced_[i].store(0);
+    }
+  }
+
+  /**
+   * @return the default settings, used by operations without their own.
+   */
+  ProgressSettings *settings() { return &settings_; }
+
+  /**
+   * @return settings if it is not nullptr, otherwise the default settings of
+   * the Tervel object.
+   */
+  static ProgressSettings *get_settings(ProgressSettings *settings) {
+    if (settings != nullptr) {
+      return settings;
+    }
+    return tervel::tl_thread_info->get_progress_assurance()->settings();
+  }
 
   /**
    * This function checks at most one position in the op_table_ for an OPRecod
@@ -166,22 +313,24 @@ class ProgressAssurance {
    * help_id_ is a variable used to track which thread to check for an
    * announcement.
 
-   * delay_count_ is a variable used to delay how often a thread checks for an
-   * annoucnement
+   * The delay count, which delays how often a thread checks for an
+   * announcement, is kept per settings, see delay_count.
   */
   static void check_for_announcement(ProgressAssurance * const progress_assuarance =
-        nullptr) {
-    static __thread int64_t delay_count = HELP_DELAY;
+        nullptr, ProgressSettings *settings = nullptr) {
     static __thread int64_t help_id = 0;
+    int64_t &delay = delay_count(settings);
 
-    if (delay_count-- == 0) {
-      delay_count = HELP_DELAY;
-      if (progress_assuarance ==  nullptr) {
-        tervel::tl_thread_info->get_progress_assurance()->
-          p_check_for_announcement(help_id);
-      } else {
-        progress_assuarance->p_check_for_announcement(help_id);
+    if (delay-- == 0) {
+      ProgressAssurance *prog_assur = progress_assuarance;
+      if (prog_assur ==  nullptr) {
+        prog_assur = tervel::tl_thread_info->get_progress_assurance();
+      }
+      if (settings == nullptr) {
+        settings = prog_assur->settings();
       }
+      delay = settings->help_delay();
+      prog_assur->p_check_for_announcement(help_id);
     }
   }
 
@@ -196,35 +345,109 @@ class ProgressAssurance {
     #if tervel_track_announcement_count  == tervel_track_enable
         TERVEL_METRIC(announcement_count)
     #endif
-    prog_assur->p_make_announcement(op, tid);
+    prog_assur->p_make_announcement(op, tid, prog_assur->settings());
+  }
+
+  /**
+   * Same as above, but the announcement counts towards settings, which are
+   * the settings the operation was delayed with.
+   */
+  static void make_announcement(OpRecord *op, ProgressSettings *settings) {
+    #if tervel_track_announcement_count  == tervel_track_enable
+        TERVEL_METRIC(announcement_count)
+    #endif
+    ProgressAssurance *prog_assur =
+        tervel::tl_thread_info->get_progress_assurance();
+    if (settings == nullptr) {
+      settings = prog_assur->settings();
+    }
+    prog_assur->p_make_announcement(op,
+        tervel::tl_thread_info->get_thread_id(), settings);
   }
 
  private:
   /**
-   * This function checks at most one position in the op_table_ for an OPRecod
-   * If one is found it will call its help_complete function.
+   * The calling thread's countdown to its next check for announcements with
+   * settings (nullptr for the default settings), so that containers with
+   * different help delays each check on their own delay. Each thread keeps
+   * the counts of a few settings; a settings which is new or was evicted
+   * starts at 0, so sharing the slots only causes earlier checks.
+   */
+  static int64_t &delay_count(ProgressSettings *settings) {
+    struct DelayCount {
+      ProgressSettings *settings;
+      int64_t count;
+    };
+    static const size_t kNumDelayCounts = 8;
+    static __thread DelayCount counts[kNumDelayCounts];
+    static __thread size_t next_count;
+
+    for (size_t i = 0; i < kNumDelayCounts; i++) {
+      if (counts[i].settings == settings) {
+        return counts[i].count;
+      }
+    }
+    DelayCount &res = counts[next_count];
+    next_count = (next_count + 1) % kNumDelayCounts;
+    res.settings = settings;
+    res.count = 0;
+    return res.count;
+  }
+
+  /**
+   * This function uses announced_ to find the next thread after hpos with an
+   * OpRecord in the op_table_ and calls its help_complete function.
+   * With TERVEL_PROG_ASSUR_HELP_ALL it instead helps every announced OpRecord.
    */
   void p_check_for_announcement(int64_t &hpos);
 
+  /**
+   * @return the first thread after the passed one with its announced_ bit set,
+   * wrapping around, or -1 if no thread has.
+   */
+  int64_t next_announced(int64_t after);
+
+  /**
+   * Watches and completes the OpRecord in op_table_[id], if there is one.
+   */
+  void help(int64_t id);
+
   /**
    * This function places the
    * @param op an OpRecord to complete
    * @return on return the OpRecord must be completed.
    */
-  void p_make_announcement(OpRecord *op, const uint64_t tid =
-        tervel::tl_thread_info->get_thread_id());
+  void p_make_announcement(OpRecord *op, const uint64_t tid,
+        ProgressSettings *settings);
 
   /**
    * Table for storing operation records, each thread has its own position
-   * that corresponds to its thread if.
+   * that corresponds to its thread if. Positions are padded so an
+   * announcement does not invalidate the lines other threads are checking.
    */
-  std::unique_ptr<std::atomic<OpRecord *>[]> op_table_;
+  std::unique_ptr<PaddedAtomic<OpRecord *>[]> op_table_;
 
   /**
    * The number of threads that are using this operation table
    */
   const int64_t num_threads_;
 
+  /**
+   * The number of 64 bit words in announced_
+   */
+  const int64_t num_words_;
+
+  /**
+   * A bitmap with a bit set for each position of the op_table_ that holds an
+   * OpRecord, so that checking threads do not need to load empty positions.
+   */
+  std::unique_ptr<PaddedAtomic<uint64_t>[]> announced_;
+
+  /**
+   * The default settings
+   */
+  ProgressSettings settings_;
+
   DISALLOW_COPY_AND_ASSIGN(ProgressAssurance);
 };
 
@@ -41,6 +41,17 @@ namespace util {
 #define  CACHE_LINE_SIZE 64
 #endif
 
+// The number of upper bits of a pointer which are unused by user-space
+// addresses and may hold a tag, see TaggedPtr. It may be defined as 0 on the
+// command line to build without tags.
+#ifndef TERVEL_ADDRESS_TAG_BITS
+#if defined(__x86_64__) || defined(__aarch64__)
+#define TERVEL_ADDRESS_TAG_BITS 16
+#else
+#define TERVEL_ADDRESS_TAG_BITS 0
+#endif
+#endif
+
 }  // namespace util
 }  // namespace tervel
 
@@ -0,0 +1,260 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 University of Central Florida's Computer Software Engineering
+Scalable & Secure Systems (CSE - S3) Lab
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef TERVEL_UTIL_TAGGED_PTR_H_
+#define TERVEL_UTIL_TAGGED_PTR_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tuple>
+
+#include <tervel/util/system.h>
+
+namespace tervel {
+namespace util {
+
+/**
+ * A tag of Bits bits stored in the low bits of a pointer, which are zero due
+ * to the alignment of the pointed to type.
+ */
+template<size_t Bits>
+struct LowTag {
+  static constexpr bool high = false;
+  static constexpr size_t bits = Bits;
+};
+
+/**
+ * A tag of Bits bits stored in the upper bits of a pointer, which are unused
+ * by user-space addresses (TERVEL_ADDRESS_TAG_BITS of them). Large enough
+ * for ABA counters and sequence ids.
+ */
+template<size_t Bits>
+struct HighTag {
+  static constexpr bool high = true;
+  static constexpr size_t bits = Bits;
+};
+
+/**
+ * The alignment of the types a TaggedPtr<T> may point to, the number of low
+ * bits available for tags is log2 of this value. Specialize it for types
+ * which are allocated with a larger alignment than alignof(T).
+ */
+template<typename T>
+struct tagged_ptr_alignment {
+  static constexpr size_t value = alignof(T);
+};
+
+template<>
+struct tagged_ptr_alignment<void> {
+  static constexpr size_t value = 1;
+};
+
+namespace tagged_ptr_detail {
+
+constexpr size_t log2(size_t value) {
+  return value <= 1 ? 0 : 1 + log2(value / 2);
+}
+
+// The total number of bits of the tags of the given kind.
+template<bool High, typename... Tags>
+struct TotalBits {
+  static constexpr size_t value = 0;
+};
+
+template<bool High, typename Tag, typename... Rest>
+struct TotalBits<High, Tag, Rest...> {
+  static constexpr size_t value = (Tag::high == High ? Tag::bits : 0) +
+      TotalBits<High, Rest...>::value;
+};
+
+// The number of bits of the tags of the given kind among the first I tags.
+template<size_t I, bool High, typename... Tags>
+struct PrefixBits {
+  static constexpr size_t value = 0;
+};
+
+template<size_t I, bool High, typename Tag, typename... Rest>
+struct PrefixBits<I, High, Tag, Rest...> {
+  static constexpr size_t value = I == 0 ? 0 :
+      (Tag::high == High ? Tag::bits : 0) +
+      PrefixBits<(I == 0 ? 0 : I - 1), High, Rest...>::value;
+};
+
+// Whether LowBits fit in the alignment bits of T, T may be incomplete when
+// there are no low tags.
+template<typename T, size_t LowBits>
+struct FitsAlignment {
+  static constexpr bool value =
+      LowBits <= log2(tagged_ptr_alignment<T>::value);
+};
+
+template<typename T>
+struct FitsAlignment<T, 0> {
+  static constexpr bool value = true;
+};
+
+// Whether every tag has at least one bit.
+template<typename... Tags>
+struct NonEmpty {
+  static constexpr bool value = true;
+};
+
+template<typename Tag, typename... Rest>
+struct NonEmpty<Tag, Rest...> {
+  static constexpr bool value = Tag::bits > 0 && NonEmpty<Rest...>::value;
+};
+
+}  // namespace tagged_ptr_detail
+
+/**
+ * A pointer to T packed into a single word with the tags Tags, each a LowTag
+ * or a HighTag. Low tags are packed upwards from bit 0 and high tags upwards
+ * from bit 64 - (total high tag bits), in the order they are listed. Whether
+ * the tags fit is checked at compile time, and encoding and decoding are
+ * branch free shifts and masks.
+ *
+ * The raw word can be stored in a std::atomic<uintptr_t> and updated with a
+ * single CAS, for example:
+ *
+ *   // A stack head with a 16 bit ABA counter
+ *   typedef TaggedPtr<Node, HighTag<16>> Head;
+ *   uintptr_t expected = top.load();
+ *   Head head = Head::from_raw(expected);
+ *   Head next = head.with_ptr(head.ptr()->next).next_tag<0>();
+ *   top.compare_exchange_strong(expected, next.raw());
+ *
+ * @tparam T the type pointed to
+ * @tparam Tags the tags, referred to by their index
+ */
+template<typename T, typename... Tags>
+class TaggedPtr {
+ public:
+  static constexpr size_t NUM_TAGS = sizeof...(Tags);
+  static constexpr size_t LOW_BITS =
+      tagged_ptr_detail::TotalBits<false, Tags...>::value;
+  static constexpr size_t HIGH_BITS =
+      tagged_ptr_detail::TotalBits<true, Tags...>::value;
+
+  static_assert(tagged_ptr_detail::NonEmpty<Tags...>::value,
+      "Each tag must have at least one bit");
+  static_assert(tagged_ptr_detail::FitsAlignment<T, LOW_BITS>::value,
+      "The low tags do not fit in the alignment bits of T");
+  static_assert(HIGH_BITS <= TERVEL_ADDRESS_TAG_BITS,
+      "The high tags do not fit in the unused upper address bits");
+  static_assert(sizeof(uintptr_t) == 8 || HIGH_BITS == 0,
+      "High tags require 64 bit pointers");
+
+  /**
+   * The bits of the word which hold the pointer.
+   */
+  static constexpr uintptr_t PTR_MASK =
+      (HIGH_BITS == 0 ? ~uintptr_t(0) :
+          (uintptr_t(1) << (64 - HIGH_BITS)) - 1) &
+      ~((uintptr_t(1) << LOW_BITS) - 1);
+
+  /**
+   * The position and width of tag I.
+   */
+  template<size_t I>
+  struct Field {
+    typedef typename std::tuple_element<I, std::tuple<Tags...>>::type Tag;
+    static constexpr size_t shift = Tag::high ?
+        64 - HIGH_BITS +
+            tagged_ptr_detail::PrefixBits<I, true, Tags...>::value :
+        tagged_ptr_detail::PrefixBits<I, false, Tags...>::value;
+    static constexpr uintptr_t mask = (uintptr_t(1) << Tag::bits) - 1;
+  };
+
+  TaggedPtr() : value_(0) {}
+
+  /**
+   * @param ptr the pointer, all tags are 0.
+   */
+  explicit TaggedPtr(T *ptr) : value_(reinterpret_cast<uintptr_t>(ptr)) {
+    assert((value_ & ~PTR_MASK) == 0 && "Pointer uses the tag bits");
+  }
+
+  static TaggedPtr from_raw(uintptr_t value) {
+    TaggedPtr res;
+    res.value_ = value;
+    return res;
+  }
+
+  /**
+   * @return the packed word.
+   */
+  uintptr_t raw() const { return value_; }
+
+  T * ptr() const {
+    return reinterpret_cast<T *>(value_ & PTR_MASK);
+  }
+
+  template<size_t I>
+  uintptr_t tag() const {
+    return (value_ >> Field<I>::shift) & Field<I>::mask;
+  }
+
+  /**
+   * @return a copy with tag I set to the low bits of tag.
+   */
+  template<size_t I>
+  TaggedPtr with_tag(uintptr_t tag) const {
+    return from_raw((value_ & ~(Field<I>::mask << Field<I>::shift)) |
+        ((tag & Field<I>::mask) << Field<I>::shift));
+  }
+
+  /**
+   * @return a copy with tag I incremented, wrapping to 0 on overflow.
+   */
+  template<size_t I>
+  TaggedPtr next_tag() const {
+    return with_tag<I>(tag<I>() + 1);
+  }
+
+  /**
+   * @return a copy pointing to ptr with the same tags.
+   */
+  TaggedPtr with_ptr(T *ptr) const {
+    uintptr_t temp = reinterpret_cast<uintptr_t>(ptr);
+    assert((temp & ~PTR_MASK) == 0 && "Pointer uses the tag bits");
+    return from_raw((value_ & ~PTR_MASK) | temp);
+  }
+
+  bool operator==(const TaggedPtr &other) const {
+    return value_ == other.value_;
+  }
+  bool operator!=(const TaggedPtr &other) const {
+    return value_ != other.value_;
+  }
+
+ private:
+  uintptr_t value_;
+};
+
+}  // namespace util
+}  // namespace tervel
+
+#endif  // TERVEL_UTIL_TAGGED_PTR_H_
@@ -29,12 +29,16 @@ THE SOFTWARE.
   #define _DS_CONFIG_INDENT "  "
 #endif
 
+#include <string>
+#include <vector>
+
 #include <tervel/util/util.h>
 #include <tervel/util/thread_context.h>
 #include <tervel/util/progress_assurance.h>
 #include <tervel/util/memory/hp/hazard_pointer.h>
 #include <tervel/util/memory/rc/pool_manager.h>
 #include <tervel/util/tervel_metrics.h>
+#include <tervel/util/numa.h>
 
 // TODO: needs doxygen
 
@@ -45,24 +49,46 @@ namespace tervel {
  */
 class Tervel {
  public:
-  explicit Tervel(size_t num_threads)
+  /**
+   * @param num_threads the maximum number of threads that will attach
+   * @param hp_slots the number of hazard pointer slots per thread
+   */
+  explicit Tervel(size_t num_threads,
+        size_t hp_slots = TERVEL_MEM_HP_NUM_SLOTS)
       : num_threads_(num_threads)
       , active_threads_(0)
-      , hazard_pointer_(num_threads)
+      , hazard_pointer_(num_threads, hp_slots)
       , rc_pool_manager_(num_threads)
       , progress_assurance_(num_threads)
-      , thread_contexts_(new ThreadContext *[num_threads]()) {}
+      , thread_contexts_(new ThreadContext *[num_threads]())
+      , event_trackers_(new std::atomic<util::EventTracker *>[num_threads]) {
+    for (size_t i = 0; i < num_threads; i++) {
+      event_trackers_[i].store(nullptr);
+    }
+  }
 
   ~Tervel() {
     // Notice: The destructor of the member variables are called when this
     // object is freed.
+    for (size_t i = 0; i < num_threads_; i++) {
+      delete event_trackers_[i].load();
+    }
   }
 
 
+  /**
+   * @return the default progress assurance settings, used by all containers
+   * that were not given their own.
+   */
+  util::ProgressSettings *progress_settings() {
+    return progress_assurance_.settings();
+  }
+
   std::string get_config_str() {
     std::string str = "";
 
     str += "\n" _DS_CONFIG_INDENT "num_threads_ : " + std::to_string(num_threads_);
+    str += "\n" _DS_CONFIG_INDENT "hp_slots_per_thread : " + std::to_string(hazard_pointer_.slots_per_thread());
     #ifdef TERVEL_MEM_HP_NO_FREE
     str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_HP_NO_FREE : True";
     #else
@@ -78,33 +104,128 @@ class Tervel {
     #else
     str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_HP_NO_WATCH : False";
     #endif
+    #ifdef TERVEL_MEM_HP_ASYMMETRIC_FENCE
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_HP_ASYMMETRIC_FENCE : True";
+    #else
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_HP_ASYMMETRIC_FENCE : False";
+    #endif
     #ifdef TERVEL_PROG_NO_ANNOUNCE
     str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_NO_ANNOUNCE : True";
     #else
     str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_NO_ANNOUNCE : False";
     #endif
+    #ifdef TERVEL_PROG_ASSUR_HELP_ALL
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_ASSUR_HELP_ALL : True";
+    #else
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_ASSUR_HELP_ALL : False";
+    #endif
     #ifdef TERVEL_MEM_RC_NO_WATCH
     str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_NO_WATCH : True";
     #else
     str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_NO_WATCH : False";
     #endif
+    #ifdef TERVEL_MEM_RC_SPLIT_HEADER
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_SPLIT_HEADER : True";
+    #else
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_SPLIT_HEADER : False";
+    #endif
+    #ifdef TERVEL_METRIC_LATENCY_STEADY_CLOCK
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_METRIC_LATENCY_STEADY_CLOCK : True";
+    #else
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_METRIC_LATENCY_STEADY_CLOCK : False";
+    #endif
+    str += "\n" _DS_CONFIG_INDENT "metric_enabled_mask : " + std::to_string(util::EventTracker::enabled_mask());
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_METRIC_LATENCY_SAMPLE_RATE : " + std::to_string(TERVEL_METRIC_LATENCY_SAMPLE_RATE);
+    #ifdef TERVEL_TRACE_ENABLED
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_TRACE_ENABLED : True";
+    #else
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_TRACE_ENABLED : False";
+    #endif
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_TRACE_RING_SIZE : " + std::to_string(TERVEL_TRACE_RING_SIZE);
+    #ifdef TERVEL_NO_NUMA
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_NO_NUMA : True";
+    #else
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_NO_NUMA : False";
+    #endif
+    str += "\n" _DS_CONFIG_INDENT "numa_nodes_ : " + std::to_string(util::numa::num_nodes());
 
     str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_MAX_NODES : " + std::to_string(TERVEL_MEM_RC_MAX_NODES);
     str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_MIN_NODES : " + std::to_string(TERVEL_MEM_RC_MIN_NODES);
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_UNSAFE_SCAN_DELAY : " + std::to_string(TERVEL_MEM_RC_UNSAFE_SCAN_DELAY);
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY : " + std::to_string(TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY);
     str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_ASSUR_DELAY : " + std::to_string(TERVEL_PROG_ASSUR_DELAY);
     str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_ASSUR_LIMIT : " + std::to_string(TERVEL_PROG_ASSUR_LIMIT);
+    str += "\n" _DS_CONFIG_INDENT "prog_assur_delay : " + std::to_string(progress_settings()->help_delay());
+    str += "\n" _DS_CONFIG_INDENT "prog_assur_limit : " + std::to_string(progress_settings()->limit());
+    str += "\n" _DS_CONFIG_INDENT "prog_assur_adaptive : " + std::to_string(progress_settings()->adaptive());
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_ASSUR_ADAPT_PERIOD : " + std::to_string(TERVEL_PROG_ASSUR_ADAPT_PERIOD);
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_PROG_ASSUR_ADAPT_RANGE : " + std::to_string(TERVEL_PROG_ASSUR_ADAPT_RANGE);
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_OP_RECORD_POOL_PREFILL : " + std::to_string(TERVEL_OP_RECORD_POOL_PREFILL);
+    str += "\n" _DS_CONFIG_INDENT "TERVEL_OP_RECORD_POOL_MAX : " + std::to_string(TERVEL_OP_RECORD_POOL_MAX);
     str += "\n" _DS_CONFIG_INDENT "TERVEL_DEF_BACKOFF_TIME_NS : " + std::to_string(TERVEL_DEF_BACKOFF_TIME_NS);
 
     return str;
   }
 
+  /**
+   * Copies the metrics of every thread that has attached, without stopping
+   * them. Trackers are owned by this object, so threads which have detached
+   * are included.
+   *
+   * @param snapshots receives a copy per thread id, starting from first.
+   * Threads which are still attaching have a nullptr entry.
+   * @param first the first thread id to include
+   */
+  void snapshot_metrics(
+        std::vector<std::unique_ptr<util::EventTracker>> *snapshots,
+        size_t first = 0) {
+    const size_t count = std::min<uint64_t>(active_threads_.load(),
+        num_threads_);
+    for (size_t i = first; i < count; i++) {
+      util::EventTracker *tracker = event_trackers_[i].load();
+      if (tracker == nullptr) {
+        snapshots->emplace_back(nullptr);
+        continue;
+      }
+      util::EventTracker *copy = new util::EventTracker();
+      tracker->snapshot(copy);
+      snapshots->emplace_back(copy);
+    }
+  }
+
+  /**
+   * Dumps the trace rings of every thread that has attached as a single
+   * Chrome trace event JSON document, see EventTracker::generateChromeTrace.
+   * Tracing is turned on through EventTracker::set_tracing.
+   *
+   * @param first the first thread id to include
+   */
+  std::string get_trace_json(size_t first = 0) {
+    const size_t count = std::min<uint64_t>(active_threads_.load(),
+        num_threads_);
+    std::vector<std::vector<util::TraceRing::Event>> traces;
+    for (size_t i = first; i < count; i++) {
+      traces.emplace_back();
+      util::EventTracker *tracker = event_trackers_[i].load();
+      if (tracker != nullptr) {
+        tracker->trace_snapshot(&traces.back());
+      }
+    }
+    return util::EventTracker::generateChromeTrace(traces, first);
+  }
+
   std::string get_metric_stats(size_t i = 0) {
     util::EventTracker track;
+    std::vector<std::unique_ptr<util::EventTracker>> snapshots;
+    snapshot_metrics(&snapshots, i);
 
     std::string s = "";
-    for (; i < active_threads_.load(); i++) {
-      s += thread_contexts_[i]->get_event_tracker()->generateYaml(i);
-      track.add(thread_contexts_[i]->get_event_tracker());
+    for (auto &snapshot : snapshots) {
+      if (snapshot != nullptr) {
+        s += snapshot->generateYaml(i);
+        track.add(snapshot.get());
+      }
+      i++;
     }
     return   "  TERVELMETRICS:\n"
              "    totals:\n"
@@ -137,6 +258,10 @@ class Tervel {
 
   std::unique_ptr<ThreadContext *[]> thread_contexts_;
 
+  // Each thread's EventTracker, which outlives the thread so that its metrics
+  // can be read after it detaches.
+  std::unique_ptr<std::atomic<util::EventTracker *>[]> event_trackers_;
+
   DISALLOW_COPY_AND_ASSIGN(Tervel);
 };
 
@@ -1,29 +1,215 @@
 #include <tervel/util/tervel_metrics.h>
 
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+
 
 namespace tervel {
 namespace util {
 
 constexpr const char* const EventTracker::event_code_strings[];
 constexpr const char* const EventTracker::event_values_strings[];
+constexpr const char* const EventTracker::latency_strings[];
+
+std::atomic<uint64_t> EventTracker::enabled_mask_(TERVEL_METRIC_ENABLED_MASK);
+#ifdef TERVEL_TRACE_ENABLED
+std::atomic<uint64_t> EventTracker::trace_mask_(
+    EventTracker::default_trace_mask());
+#else
+std::atomic<uint64_t> EventTracker::trace_mask_(0);
+#endif
+std::atomic<uint64_t> EventTracker::event_mask_(
+    EventTracker::enabled_mask_.load() | EventTracker::trace_mask_.load());
+
+void EventTracker::refresh_event_mask() {
+  // Recomputed until it matches both masks, so a concurrent change to either
+  // can not be overwritten by a stale union.
+  uint64_t mask;
+  do {
+    mask = enabled_mask_.load() | trace_mask_.load();
+    event_mask_.store(mask);
+  } while (mask != (enabled_mask_.load() | trace_mask_.load()));
+}
+
+uint64_t EventTracker::default_trace_mask() {
+  uint64_t mask = 0;
+  #if tervel_track_announcement_count == tervel_track_enable
+  mask |= bit(event_code_t::announcement_count);
+  #endif
+  #if tervel_track_helped_announcement == tervel_track_enable
+  mask |= bit(event_code_t::helped_announcement);
+  #endif
+  #if tervel_track_max_recur_depth_reached == tervel_track_enable
+  mask |= bit(event_code_t::max_recur_depth_reached);
+  #endif
+  #if tervel_track_rc_watch_fail == tervel_track_enable
+  mask |= bit(event_code_t::rc_watch_fail);
+  #endif
+  #if tervel_track_hp_watch_fail == tervel_track_enable
+  mask |= bit(event_code_t::hp_watch_fail);
+  #endif
+  return mask;
+}
+
+double EventTracker::ticks_per_us() {
+  #if (defined(__x86_64__) || defined(__i386__)) && \
+      !defined(TERVEL_METRIC_LATENCY_STEADY_CLOCK)
+    static const double ticks = []() {
+      auto start_time = std::chrono::steady_clock::now();
+      uint64_t start = latency_now();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      uint64_t end = latency_now();
+      auto end_time = std::chrono::steady_clock::now();
+      double us = std::chrono::duration<double, std::micro>(
+          end_time - start_time).count();
+      return static_cast<double>(end - start) / us;
+    }();
+    return ticks;
+  #else
+    return 1000.0;
+  #endif
+}
+
+std::string EventTracker::generateChromeTrace(
+      const std::vector<std::vector<TraceRing::Event>> &traces,
+      size_t first_tid) {
+  struct TraceEntry {
+    uint64_t timestamp;
+    uint64_t code;
+    size_t tid;
+  };
+
+  std::vector<TraceEntry> entries;
+  for (size_t t = 0; t < traces.size(); t++) {
+    for (const TraceRing::Event &e : traces[t]) {
+      if (e.code < NUM_EVENTS) {
+        entries.push_back({e.timestamp, e.code, first_tid + t});
+      }
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+      [](const TraceEntry &a, const TraceEntry &b) {
+        return a.timestamp < b.timestamp;
+      });
+
+  std::string str = "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+  for (size_t t = 0; t < traces.size(); t++) {
+    std::string tid = std::to_string(first_tid + t);
+    str += "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+        "\"tid\": " + tid + ", \"args\": {\"name\": \"tervel " + tid +
+        "\"}},";
+  }
+
+  // Timestamps are relative to the first event, in microseconds
+  const double ticks = ticks_per_us();
+  const uint64_t base = entries.empty() ? 0 : entries.front().timestamp;
+  char ts[32];
+  for (const TraceEntry &e : entries) {
+    snprintf(ts, sizeof(ts), "%.3f", (e.timestamp - base) / ticks);
+    str += "\n{\"name\": \"" + std::string(event_code_strings[e.code]) +
+        "\", \"ph\": \"i\", \"s\": \"t\", \"ts\": " + ts +
+        ", \"pid\": 0, \"tid\": " + std::to_string(e.tid) + "},";
+  }
+
+  // Drop the trailing separator
+  if (str.back() == ',') {
+    str.pop_back();
+  }
+  return str + "\n]}\n";
+}
+
+bool EventTracker::set_enabled(const std::string &name, bool enabled) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < NUM_EVENTS; i++) {
+    if (name == event_code_strings[i]) {
+      mask = bit(static_cast<event_code_t>(i));
+    }
+  }
+  for (size_t i = 0; i < NUM_VALUES; i++) {
+    if (name == event_values_strings[i]) {
+      mask = bit(static_cast<event_values_code_t>(i));
+    }
+  }
+  for (size_t i = 0; i < NUM_LATENCIES; i++) {
+    if (name == latency_strings[i]) {
+      mask = bit(static_cast<latency_code_t>(i));
+    }
+  }
+
+  if (mask == 0) {
+    return false;
+  } else if (enabled) {
+    enabled_mask_.fetch_or(mask);
+  } else {
+    enabled_mask_.fetch_and(~mask);
+  }
+  refresh_event_mask();
+  return true;
+}
+
+void EventTracker::p_recordEvent(event_code_t code) {
+  if (is_enabled(code)) {
+    p_countEventOccurance(code);
+  }
+  if ((trace_mask_.load(std::memory_order_relaxed) & bit(code)) != 0) {
+    p_traceEvent(code);
+  }
+}
 
 void EventTracker::p_countEventOccurance(event_code_t code) {
-  events_[static_cast<size_t>(code)]++;
+  // Only the owning thread writes, so no read-modify-write is needed.
+  std::atomic<uint64_t> &event = events_[static_cast<size_t>(code)];
+  event.store(event.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
 }
 
 
 
 void EventTracker::p_trackEventValue(event_values_code_t code, int64_t val) {
+  begin_write();
   event_values_[static_cast<size_t>(code)].update(val);
+  end_write();
+}
+
+void EventTracker::snapshot(EventTracker *out) {
+  for (size_t i = 0; i < NUM_EVENTS; i++) {
+    out->events_[i].store(events_[i].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+  }
+
+  while (true) {
+    uint64_t seq = seq_.load(std::memory_order_acquire);
+    if (seq & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    memcpy(out->event_values_, event_values_, sizeof(event_values_));
+    if (latencies_ != nullptr && out->latencies_ != nullptr) {
+      memcpy(out->latencies_.get(), latencies_.get(),
+          sizeof(latency_histogram_t) * NUM_LATENCIES);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq_.load(std::memory_order_relaxed) == seq) {
+      return;
+    }
+  }
 }
 
 void EventTracker::add(EventTracker *other){
   for (size_t i = 0; i < static_cast<size_t>(event_code_t::END); i++) {
-    events_[i] += other->events_[i];
+    events_[i].store(events_[i].load() + other->events_[i].load());
   }
   for (size_t i = 0; i < static_cast<size_t>(event_values_code_t::END); i++) {
     event_values_[i].add(&(other->event_values_[i]));
   }
+  if (latencies_ != nullptr && other->latencies_ != nullptr) {
+    for (size_t i = 0; i < static_cast<size_t>(latency_code_t::END); i++) {
+      latencies_[i].add(&(other->latencies_[i]));
+    }
+  }
 }
 
 std::string EventTracker::generateYaml(int tid){
@@ -37,7 +223,7 @@ std::string EventTracker::generateYaml(int tid){
     yaml_trace += "        ";
     yaml_trace += event_code_strings[i];
     yaml_trace += " : ";
-    yaml_trace += std::to_string(events_[i]);
+    yaml_trace += std::to_string(events_[i].load());
     yaml_trace += "\n";
   }
 
@@ -50,9 +236,137 @@ std::string EventTracker::generateYaml(int tid){
 
   }
 
+  if (latencies_ != nullptr) {
+    for (size_t i = 0; i< static_cast<size_t>(latency_code_t::END); i++){
+      yaml_trace += "        ";
+      yaml_trace += latency_strings[i];
+      yaml_trace += " : ";
+      yaml_trace += latencies_[i].yaml_string();
+      yaml_trace += "\n";
+    }
+  }
+
   return yaml_trace;
 }
 
+std::string EventTracker::generatePrometheus(
+      const std::vector<std::unique_ptr<EventTracker>> &trackers,
+      size_t first_tid) {
+  // Samples of a metric must be grouped, so metrics are the outer loop.
+  std::string str = "";
+  std::vector<std::string> labels;
+  for (size_t t = 0; t < trackers.size(); t++) {
+    labels.push_back("{thread=\"" + std::to_string(first_tid + t) + "\"");
+  }
+
+  for (size_t i = 0; i < NUM_EVENTS; i++) {
+    const std::string name = std::string("tervel_") + event_code_strings[i];
+    str += "# TYPE " + name + " counter\n";
+    for (size_t t = 0; t < trackers.size(); t++) {
+      if (trackers[t] == nullptr) {
+        continue;
+      }
+      str += name + labels[t] + "} " +
+          std::to_string(trackers[t]->events_[i].load()) + "\n";
+    }
+  }
+
+  for (size_t i = 0; i < NUM_VALUES; i++) {
+    const std::string name = std::string("tervel_") + event_values_strings[i];
+    str += "# TYPE " + name + "_mean gauge\n";
+    for (size_t t = 0; t < trackers.size(); t++) {
+      if (trackers[t] == nullptr) {
+        continue;
+      }
+      str += name + "_mean" + labels[t] + "} " +
+          std::to_string(trackers[t]->event_values_[i].mean) + "\n";
+    }
+    str += "# TYPE " + name + "_variance gauge\n";
+    for (size_t t = 0; t < trackers.size(); t++) {
+      if (trackers[t] == nullptr) {
+        continue;
+      }
+      str += name + "_variance" + labels[t] + "} " +
+          std::to_string(trackers[t]->event_values_[i].variance()) + "\n";
+    }
+    str += "# TYPE " + name + "_count counter\n";
+    for (size_t t = 0; t < trackers.size(); t++) {
+      if (trackers[t] == nullptr) {
+        continue;
+      }
+      str += name + "_count" + labels[t] + "} " + std::to_string(
+          static_cast<uint64_t>(trackers[t]->event_values_[i].card)) + "\n";
+    }
+  }
+
+  for (size_t i = 0; i < NUM_LATENCIES; i++) {
+    const std::string name = std::string("tervel_") + latency_strings[i];
+    str += "# TYPE " + name + " summary\n";
+    for (size_t t = 0; t < trackers.size(); t++) {
+      if (trackers[t] == nullptr || trackers[t]->latencies_ == nullptr) {
+        continue;
+      }
+      latency_histogram_t &h = trackers[t]->latencies_[i];
+      str += name + labels[t] + ",quantile=\"0.5\"} " +
+          std::to_string(h.percentile(0.5)) + "\n";
+      str += name + labels[t] + ",quantile=\"0.99\"} " +
+          std::to_string(h.percentile(0.99)) + "\n";
+      str += name + labels[t] + ",quantile=\"0.999\"} " +
+          std::to_string(h.percentile(0.999)) + "\n";
+      str += name + "_count" + labels[t] + "} " + std::to_string(h.total) +
+          "\n";
+    }
+    str += "# TYPE " + name + "_max gauge\n";
+    for (size_t t = 0; t < trackers.size(); t++) {
+      if (trackers[t] == nullptr || trackers[t]->latencies_ == nullptr) {
+        continue;
+      }
+      str += name + "_max" + labels[t] + "} " +
+          std::to_string(trackers[t]->latencies_[i].max) + "\n";
+    }
+  }
+
+  return str;
+}
+
+std::string EventTracker::generateJson(int tid) {
+  std::string str = "{";
+  if (tid != -1) {
+    str += "\"tid\": " + std::to_string(tid) + ", ";
+  }
+
+  for (size_t i = 0; i < NUM_EVENTS; i++) {
+    str += "\"" + std::string(event_code_strings[i]) + "\": " +
+        std::to_string(events_[i].load()) + ", ";
+  }
+
+  for (size_t i = 0; i < NUM_VALUES; i++) {
+    event_values_t &v = event_values_[i];
+    str += "\"" + std::string(event_values_strings[i]) + "\": {" +
+        "\"mean\": " + std::to_string(v.mean) +
+        ", \"variance\": " + std::to_string(v.variance()) +
+        ", \"card\": " + std::to_string(v.card) + "}, ";
+  }
+
+  if (latencies_ != nullptr) {
+    for (size_t i = 0; i < NUM_LATENCIES; i++) {
+      latency_histogram_t &h = latencies_[i];
+      str += "\"" + std::string(latency_strings[i]) + "\": {" +
+          "\"count\": " + std::to_string(h.total) +
+          ", \"p50\": " + std::to_string(h.percentile(0.5)) +
+          ", \"p99\": " + std::to_string(h.percentile(0.99)) +
+          ", \"p99_9\": " + std::to_string(h.percentile(0.999)) +
+          ", \"max\": " + std::to_string(h.max) + "}, ";
+    }
+  }
+
+  // Drop the trailing separator
+  if (str.size() > 1) {
+    str.resize(str.size() - 2);
+  }
+  return str + "}";
+}
+
 
 }
 }
@@ -27,6 +27,20 @@ THE SOFTWARE.
 #define TERVEL_UTIL_TERVEL_METRICS_H_
 #include <tervel/util/util.h>
 #include <tervel/util/info.h>
+#include <tervel/util/system.h>
+#include <tervel/util/event_trace.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdlib.h>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
 
 // TODO: needs doxygen
 
@@ -34,40 +48,132 @@ namespace tervel {
 namespace util{
 
 // Struct used to track average values of a variable.
+// Uses Welford's algorithm, m2 is the sum of squared differences from the mean.
 typedef struct event_values_t{
-  float mean;
-  float variance;
-  float card;
+  double mean;
+  double m2;
+  double card;
 
   void operator()() {
     mean = 0;
-    variance = 0;
+    m2 = 0;
     card = 0;
   }
 
   void update(int64_t value) {
-    mean =  ((mean * card) + value) / (card + 1.0);
-    float diff = value - mean;
-    variance = ((variance * (card * card)) + (diff * diff));
     card += 1.0;
-    variance = variance / (card * card);
+    double diff = value - mean;
+    mean += diff / card;
+    m2 += diff * (value - mean);
   }
 
+  // Combines the values tracked by two threads.
   void add(struct event_values_t *other) {
-    mean += other->mean;
-    variance += other->variance;
-    card += other->card;
+    if (other->card == 0) {
+      return;
+    }
+    double total = card + other->card;
+    double diff = other->mean - mean;
+    mean += diff * (other->card / total);
+    m2 += other->m2 + diff * diff * (card * other->card / total);
+    card = total;
+  }
+
+  double variance() {
+    return card > 0 ? m2 / card : 0;
   }
 
   std::string yaml_string() {
     std::string str = "";
     str += "\n          mean : " + std::to_string(mean);
-    str += "\n          variance : " + std::to_string(variance);
+    str += "\n          variance : " + std::to_string(variance());
     str += "\n          card : " + std::to_string(card);
     return str;
   }
 }event_values_t;
 
+// Log-linear histogram used to track latencies.
+// Values below SUB_BUCKETS have their own bucket, above that each power of two
+// is split into SUB_BUCKETS linear buckets, so a reported percentile is within
+// 1/SUB_BUCKETS of the recorded value.
+typedef struct latency_histogram_t{
+  static constexpr size_t SUB_BUCKET_BITS = 4;
+  static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr size_t NUM_BUCKETS = SUB_BUCKETS * (65 - SUB_BUCKET_BITS);
+
+  uint64_t counts[NUM_BUCKETS];
+  uint64_t total;
+  uint64_t max;
+
+  void operator()() {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+      counts[i] = 0;
+    }
+    total = 0;
+    max = 0;
+  }
+
+  static size_t bucket(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+    size_t shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+    return SUB_BUCKETS * (shift + 1) + ((value >> shift) & (SUB_BUCKETS - 1));
+  }
+
+  // The largest value that falls into bucket i.
+  static uint64_t bucket_value(size_t i) {
+    if (i < SUB_BUCKETS) {
+      return i;
+    }
+    size_t shift = i / SUB_BUCKETS - 1;
+    uint64_t sub_bucket = i % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+  }
+
+  void update(uint64_t value) {
+    counts[bucket(value)]++;
+    total++;
+    if (value > max) {
+      max = value;
+    }
+  }
+
+  void add(struct latency_histogram_t *other) {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+      counts[i] += other->counts[i];
+    }
+    total += other->total;
+    if (other->max > max) {
+      max = other->max;
+    }
+  }
+
+  // @param p the percentile, in (0, 1]
+  uint64_t percentile(double p) {
+    uint64_t target = static_cast<uint64_t>(std::ceil(p * total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+      seen += counts[i];
+      if (seen >= target && seen > 0) {
+        uint64_t value = bucket_value(i);
+        return value < max ? value : max;
+      }
+    }
+    return max;
+  }
+
+  std::string yaml_string() {
+    std::string str = "";
+    str += "\n          count : " + std::to_string(total);
+    str += "\n          p50 : " + std::to_string(percentile(0.5));
+    str += "\n          p99 : " + std::to_string(percentile(0.99));
+    str += "\n          p99_9 : " + std::to_string(percentile(0.999));
+    str += "\n          max : " + std::to_string(max);
+    return str;
+  }
+}latency_histogram_t;
+
 /**
 * Start of Event tracker class
 */
@@ -89,13 +195,23 @@ typedef struct event_values_t{
 
 
 #define TERVEL_METRIC_TRACK_VALUE(metric_name, value) {\
-  if (tervel_track_##metric_name) {\
+  if (tervel_track_##metric_name && util::EventTracker::is_enabled( \
+        util::EventTracker::event_values_code_t::metric_name)) {\
     util::EventTracker::trackEventValue(util::EventTracker::event_values_code_t::metric_name, value); \
   }\
 }
+
+/**
+ * Records the latency of the enclosing scope in the calling thread's histogram
+ * for op_name, see LatencyTimer.
+ */
+#define TERVEL_METRIC_LATENCY(op_name) \
+  util::LatencyTimer tervel_latency_timer_( \
+      util::EventTracker::latency_code_t::op_name);
 #else
   #define TERVEL_METRIC(metric_name) {;};
   #define TERVEL_METRIC_TRACK_VALUE(metric_name, value) {;};
+  #define TERVEL_METRIC_LATENCY(op_name) {;};
 #endif
 
 
@@ -110,11 +226,16 @@ public:
   #define tervel_track_max_recur_depth_reached tervel_track_enable
   #define tervel_track_rc_watch_fail tervel_track_enable
   #define tervel_track_hp_watch_fail tervel_track_enable
+  #define tervel_track_hp_retired tervel_track_enable
+  #define tervel_track_hp_reclaimed tervel_track_enable
   #define tervel_track_rc_remove_descr tervel_track_enable
   #define tervel_track_rc_is_descr tervel_track_enable
   #define tervel_track_rc_offload tervel_track_enable
+  #define tervel_track_rc_unsafe_scan tervel_track_enable
+  #define tervel_track_rc_unsafe_scan_length tervel_track_enable
   #define tervel_track_helped_announcement tervel_track_enable
   #define tervel_track_is_delayed_count tervel_track_enable
+  #define tervel_track_op_latency tervel_track_enable
 
 
   enum class event_code_t : size_t {
@@ -133,6 +254,12 @@ public:
     #if tervel_track_hp_watch_fail == tervel_track_enable
     hp_watch_fail,
     #endif
+    #if tervel_track_hp_retired == tervel_track_enable
+    hp_retired,
+    #endif
+    #if tervel_track_hp_reclaimed == tervel_track_enable
+    hp_reclaimed,
+    #endif
     #if tervel_track_rc_remove_descr == tervel_track_enable
     rc_remove_descr,
     #endif
@@ -142,6 +269,9 @@ public:
     #if tervel_track_rc_offload == tervel_track_enable
     rc_offload,
     #endif
+    #if tervel_track_rc_unsafe_scan == tervel_track_enable
+    rc_unsafe_scan,
+    #endif
     #if tervel_track_is_delayed_count == tervel_track_enable
     is_delayed_count,
     #endif
@@ -164,6 +294,12 @@ public:
     #if tervel_track_hp_watch_fail == tervel_track_enable
     "hp_watch_fail",
     #endif
+    #if tervel_track_hp_retired == tervel_track_enable
+    "hp_retired",
+    #endif
+    #if tervel_track_hp_reclaimed == tervel_track_enable
+    "hp_reclaimed",
+    #endif
     #if tervel_track_rc_remove_descr == tervel_track_enable
     "rc_remove_descr",
     #endif
@@ -173,6 +309,9 @@ public:
     #if tervel_track_rc_offload == tervel_track_enable
     "rc_offload",
     #endif
+    #if tervel_track_rc_unsafe_scan == tervel_track_enable
+    "rc_unsafe_scan",
+    #endif
     #if tervel_track_is_delayed_count == tervel_track_enable
     "is_delayed_count",
     #endif
@@ -183,6 +322,9 @@ public:
     #if tervel_track_limit_value == tervel_track_enable
     limit_value,
     #endif
+    #if tervel_track_rc_unsafe_scan_length == tervel_track_enable
+    rc_unsafe_scan_length,
+    #endif
     END
   };
 
@@ -190,37 +332,316 @@ public:
     #if tervel_track_limit_value == tervel_track_enable
     "limit_value",
     #endif
+    #if tervel_track_rc_unsafe_scan_length == tervel_track_enable
+    "rc_unsafe_scan_length",
+    #endif
     ""
   };
 
 
+  enum class latency_code_t : size_t {
+    #if tervel_track_op_latency == tervel_track_enable
+    enqueue,
+    dequeue,
+    push,
+    pop,
+    insert,
+    at,
+    remove,
+    mcas,
+    #endif
+    END
+  };
+
+  static const constexpr char* const latency_strings[] = {
+    #if tervel_track_op_latency == tervel_track_enable
+    "latency_enqueue",
+    "latency_dequeue",
+    "latency_push",
+    "latency_pop",
+    "latency_insert",
+    "latency_at",
+    "latency_remove",
+    "latency_mcas",
+    #endif
+    ""
+  };
+
+
+  static constexpr size_t NUM_EVENTS = static_cast<size_t>(event_code_t::END);
+  static constexpr size_t NUM_VALUES =
+      static_cast<size_t>(event_values_code_t::END);
+  static constexpr size_t NUM_LATENCIES =
+      static_cast<size_t>(latency_code_t::END);
+  static_assert(NUM_EVENTS + NUM_VALUES + NUM_LATENCIES <= 64,
+      "Every metric needs a bit in the enabled mask");
+
+
   std::string generateYaml(int tid = -1);
 
+  /**
+   * @return the metrics of trackers in the Prometheus text exposition format,
+   * with the thread id as a label. Entries may be nullptr.
+   * @param first_tid the thread id of the first tracker
+   */
+  static std::string generatePrometheus(
+        const std::vector<std::unique_ptr<EventTracker>> &trackers,
+        size_t first_tid = 0);
+
+  /**
+   * @return the metrics as a JSON object.
+   */
+  std::string generateJson(int tid = -1);
+
+  /**
+   * Copies the metrics of this tracker into out while the owning thread keeps
+   * running. Counters are monotonic and read individually, values and
+   * latencies are read under seq_ and so are consistent with each other.
+   * out must have been constructed with the same build settings.
+   */
+  void snapshot(EventTracker *out);
+
   EventTracker()
-  : events_(new uint64_t[static_cast<size_t>(event_code_t::END)]())
-  , event_values_(new event_values_t[static_cast<size_t>(event_values_code_t::END)]())
+  : events_()
+  , event_values_()
+  #ifdef USE_TERVEL_METRICS
+  , latencies_(new latency_histogram_t[NUM_LATENCIES]())
+  , trace_(new TraceRing())
+  #endif
   {}
 
+  /**
+   * Trackers are cache line aligned and padded, so that the counters of
+   * different threads do not share lines.
+   */
+  static void * operator new(size_t size) {
+    void *ptr;
+    if (posix_memalign(&ptr, CACHE_LINE_SIZE, size) != 0) {
+      throw std::bad_alloc();
+    }
+    return ptr;
+  }
+
+  static void operator delete(void *ptr) {
+    free(ptr);
+  }
+
   static void countEvent(EventTracker::event_code_t code,
-  EventTracker* tracker = tervel::tl_thread_info->get_event_tracker()) {
-    tracker->p_countEventOccurance(code);
+  EventTracker* tracker = tervel::tl_event_tracker) {
+    // event_mask_ is the union of the enabled and traced events, so an event
+    // that is neither costs one load and one branch.
+    if ((event_mask_.load(std::memory_order_relaxed) & bit(code)) != 0) {
+      tracker->p_recordEvent(code);
+    }
   };
 
   static void trackEventValue(EventTracker::event_values_code_t code, int64_t val,
-  EventTracker* tracker = tervel::tl_thread_info->get_event_tracker()) {
+  EventTracker* tracker = tervel::tl_event_tracker) {
     tracker->p_trackEventValue(code, val);
   };
 
+  // ----------------------
+  // Runtime enabled metrics
+  // ----------------------
+  // Each metric has a bit in enabled_mask_, a metric which is compiled in is
+  // only tracked while its bit is set. Events use bits [0, NUM_EVENTS), then
+  // values and latencies follow.
+
+  static uint64_t bit(event_code_t code) {
+    return 1ULL << static_cast<size_t>(code);
+  }
+  static uint64_t bit(event_values_code_t code) {
+    return 1ULL << (NUM_EVENTS + static_cast<size_t>(code));
+  }
+  static uint64_t bit(latency_code_t code) {
+    return 1ULL << (NUM_EVENTS + NUM_VALUES + static_cast<size_t>(code));
+  }
+
+  template<typename Code>
+  static bool is_enabled(Code code) {
+    return (enabled_mask_.load(std::memory_order_relaxed) & bit(code)) != 0;
+  }
+
+  template<typename Code>
+  static void enable(Code code) {
+    enabled_mask_.fetch_or(bit(code));
+    refresh_event_mask();
+  }
+
+  template<typename Code>
+  static void disable(Code code) {
+    enabled_mask_.fetch_and(~bit(code));
+    refresh_event_mask();
+  }
+
+  static uint64_t enabled_mask() { return enabled_mask_.load(); }
+  static void set_enabled_mask(uint64_t mask) {
+    enabled_mask_.store(mask);
+    refresh_event_mask();
+  }
+
+  /**
+   * Enables or disables a metric by the name used in the YAML output.
+   * @return whether or not a metric with that name exists
+   */
+  static bool set_enabled(const std::string &name, bool enabled);
+
+  // ----------------------
+  // Event tracing
+  // ----------------------
+  // Events whose bit is set in trace_mask_ are also recorded with a timestamp
+  // in the thread's trace ring, which keeps the most recent
+  // TERVEL_TRACE_RING_SIZE events. See generateChromeTrace.
+
+  /**
+   * Turns tracing of the slow path events (announcements, helps, watch
+   * failures and reaching the recursion limit) on or off.
+   */
+  static void set_tracing(bool enabled) {
+    trace_mask_.store(enabled ? default_trace_mask() : 0);
+    refresh_event_mask();
+  }
+  static bool is_tracing() { return trace_mask_.load() != 0; }
+  static uint64_t trace_mask() { return trace_mask_.load(); }
+  static void set_trace_mask(uint64_t mask) {
+    trace_mask_.store(mask);
+    refresh_event_mask();
+  }
+  static uint64_t default_trace_mask();
+
+  /**
+   * Appends the events in this thread's trace ring to out, oldest first. Safe
+   * to call while the owning thread keeps running.
+   */
+  void trace_snapshot(std::vector<TraceRing::Event> *out) {
+    if (trace_ != nullptr) {
+      trace_->snapshot(out);
+    }
+  }
+
+  /**
+   * Merges the traces of several threads into a Chrome trace event JSON
+   * document, which can be loaded in chrome://tracing or Perfetto. Each event
+   * is an instant event on the track of the thread which recorded it.
+   *
+   * @param traces a trace per thread, as returned by trace_snapshot
+   * @param first_tid the thread id of the first trace
+   */
+  static std::string generateChromeTrace(
+        const std::vector<std::vector<TraceRing::Event>> &traces,
+        size_t first_tid = 0);
+
+  /**
+   * @return the number of latency_now() ticks per microsecond, measured once
+   * when timestamps are cycles.
+   */
+  static double ticks_per_us();
+
   void p_countEventOccurance(event_code_t code);
+  void p_recordEvent(event_code_t code);
+  void p_traceEvent(event_code_t code) {
+    trace_->record(latency_now(), static_cast<uint64_t>(code));
+  }
   void p_trackEventValue(event_values_code_t code, int64_t val);
+  void p_trackLatency(latency_code_t code, uint64_t val) {
+    begin_write();
+    latencies_[static_cast<size_t>(code)].update(val);
+    end_write();
+  }
+
+  /**
+   * Marks the start and end of an update to event_values_ or latencies_ by
+   * the owning thread, see snapshot().
+   */
+  void begin_write() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  void end_write() {
+    seq_.store(seq_.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+  }
   void add(EventTracker *other);
 
+  /**
+   * @return the current time in the unit latencies are recorded in, cycles
+   * from rdtsc or, with TERVEL_METRIC_LATENCY_STEADY_CLOCK or on other
+   * architectures, nanoseconds from std::chrono::steady_clock.
+   */
+  static uint64_t latency_now() {
+    #if (defined(__x86_64__) || defined(__i386__)) && \
+        !defined(TERVEL_METRIC_LATENCY_STEADY_CLOCK)
+      return __rdtsc();
+    #else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+    #endif
+  }
+
+  /**
+   * @return whether the next operation's latency should be recorded, one in
+   * every TERVEL_METRIC_LATENCY_SAMPLE_RATE operations is.
+   */
+  bool sample_latency() {
+    if (--latency_countdown_ == 0) {
+      latency_countdown_ = TERVEL_METRIC_LATENCY_SAMPLE_RATE;
+      return true;
+    }
+    return false;
+  }
+
 public:
   ~EventTracker(){}
 
-  std::unique_ptr<uint64_t[]> events_;
-  std::unique_ptr<event_values_t[]> event_values_;
+  char padding_before_[CACHE_LINE_SIZE];
+  // Written only by the owning thread, read by snapshot()
+  std::atomic<uint64_t> events_[NUM_EVENTS + 1];
+  // Odd while the owning thread updates event_values_ or latencies_
+  std::atomic<uint64_t> seq_ {0};
+  event_values_t event_values_[NUM_VALUES + 1];
+  // Only allocated with USE_TERVEL_METRICS
+  std::unique_ptr<latency_histogram_t[]> latencies_;
+  uint64_t latency_countdown_ {1};
+  // Only allocated with USE_TERVEL_METRICS
+  std::unique_ptr<TraceRing> trace_;
+  char padding_after_[CACHE_LINE_SIZE];
+
+ private:
+  static std::atomic<uint64_t> enabled_mask_;
+  static std::atomic<uint64_t> trace_mask_;
+  // enabled_mask_ | trace_mask_, checked first by countEvent.
+  static std::atomic<uint64_t> event_mask_;
+
+  static void refresh_event_mask();
+};
+
+/**
+ * Records the time between its construction and destruction in the calling
+ * thread's latency histogram for an operation, if the operation is sampled.
+ * Use the TERVEL_METRIC_LATENCY macro rather than this class directly.
+ */
+class LatencyTimer {
+ public:
+  explicit LatencyTimer(EventTracker::latency_code_t code,
+        EventTracker* tracker = tervel::tl_event_tracker)
+    : code_(code)
+    , tracker_(tracker)
+    , start_(EventTracker::is_enabled(code) && tracker->sample_latency() ?
+          EventTracker::latency_now() : 0) {}
+
+  ~LatencyTimer() {
+    if (start_ != 0) {
+      tracker_->p_trackLatency(code_, EventTracker::latency_now() - start_);
+    }
+  }
+
+ private:
+  const EventTracker::latency_code_t code_;
+  EventTracker * const tracker_;
+  const uint64_t start_;
 
+  DISALLOW_COPY_AND_ASSIGN(LatencyTimer);
 };
 
 /**
@@ -28,6 +28,8 @@ THE SOFTWARE.
 #include <tervel/util/memory/hp/hp_list.h>
 #include <tervel/util/memory/rc/descriptor_pool.h>
 #include <tervel/util/tervel_metrics.h>
+#include <tervel/util/op_record_pool.h>
+#include <tervel/util/numa.h>
 
 #include <stdint.h>
 
@@ -36,11 +38,16 @@ namespace tervel {
 ThreadContext::ThreadContext(Tervel* tervel)
     : tervel_ {tervel}
     , thread_id_(tervel_->get_thread_id())
+    , numa_node_(util::numa::current_node())
     , hp_element_list_(tervel_->hazard_pointer_.hp_list_manager_.allocate_list())
-    , rc_descriptor_pool_(tervel_->rc_pool_manager_.allocate_pool(thread_id_))
-    , eventTracker_(new util::EventTracker()){
+    , rc_descriptor_pool_(tervel_->rc_pool_manager_.allocate_pool(thread_id_,
+          numa_node_))
+    , eventTracker_(new util::EventTracker())
+    , op_record_pool_(new util::OpRecordPool()) {
   tl_thread_info = this;
+  tl_event_tracker = eventTracker_;
   tervel->thread_contexts_[thread_id_] = this;
+  tervel->event_trackers_[thread_id_].store(eventTracker_);
 
 }
 
@@ -51,8 +58,12 @@ ThreadContext::~ThreadContext() {
   if (hp_element_list_ != nullptr) {
     delete hp_element_list_;
   }
+  // Deleted after the element list, as freeing its elements may return
+  // OpRecords to the pool.
+  delete op_record_pool_;
 
   tl_thread_info = nullptr;
+  tl_event_tracker = nullptr;
 }
 
 util::memory::hp::HazardPointer * const ThreadContext::get_hazard_pointer() {
@@ -79,9 +90,17 @@ const uint64_t ThreadContext::get_num_threads() {
   return tervel_->num_threads_;
 }
 
+const size_t ThreadContext::get_numa_node() {
+  return numa_node_;
+}
+
 util::EventTracker* const ThreadContext::get_event_tracker() {
   return eventTracker_;
 }
 
+util::OpRecordPool * const ThreadContext::get_op_record_pool() {
+  return op_record_pool_;
+}
+
 
 }  // namespace tervel
@@ -39,6 +39,7 @@ namespace util {
 class RecursiveAction;
 class ProgressAssurance;
 class EventTracker;
+class OpRecordPool;
 
 namespace memory {
 namespace hp {
@@ -87,6 +88,11 @@ class ThreadContext {
 
   util::EventTracker * const get_event_tracker();
 
+  /**
+   * @returns a reference to the op_record_pool_
+   */
+  util::OpRecordPool * const get_op_record_pool();
+
 
   /**
    * A unique ID among all active threads.
@@ -98,6 +104,12 @@ class ThreadContext {
    */
   const uint64_t get_num_threads();
 
+  /**
+   * The NUMA node the thread was running on when it attached.
+   * @return the threads numa node.
+   */
+  const size_t get_numa_node();
+
  private:
 
   /**
@@ -106,9 +118,11 @@ class ThreadContext {
    */
   Tervel * const tervel_;
   const uint64_t thread_id_;
+  const size_t numa_node_;
   util::memory::hp::ElementList * const hp_element_list_;
   util::memory::rc::DescriptorPool * const rc_descriptor_pool_;
   util::EventTracker * const eventTracker_;
+  util::OpRecordPool * const op_record_pool_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(ThreadContext);
@@ -61,6 +61,19 @@ namespace util {
   #endif
 #endif
 
+// #define TERVEL_MEM_HP_ASYMMETRIC_FENCE
+ // hazard pointer watches are published with a release store and a compiler
+ // barrier instead of a full fence. Threads freeing elements instead issue
+ // membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) once per scan of their unsafe
+ // list. Falls back to full fences if membarrier is not supported. Linux only.
+
+// #define TERVEL_MEM_HP_NUM_SLOTS
+ // the default number of hazard pointer slots per thread. This includes the
+ // named HazardPointer::SlotIDs, the remaining slots are used by HazardGuards.
+#ifndef TERVEL_MEM_HP_NUM_SLOTS
+ #define TERVEL_MEM_HP_NUM_SLOTS 8
+#endif
+
 // #define TERVEL_MEM_RC_NO_FREE
 // -causes new objects to be allocated from the allocator
 
@@ -80,12 +93,72 @@ namespace util {
  #define TERVEL_MEM_RC_MIN_NODES 5
 #endif
 
+// #define TERVEL_MEM_RC_SPLIT_HEADER
+ // places the reference count of a pool element on its own cache line instead
+ // of sharing the descriptor's line. Doubles the size of each pool element.
+
+// #define TERVEL_MEM_RC_UNSAFE_SCAN_DELAY
+ // the number of descriptor allocations between scans of the unsafe pool.
+ // The unsafe pool is also scanned when the safe pool is empty or when it
+ // holds more than TERVEL_MEM_RC_MAX_NODES elements.
+#ifndef TERVEL_MEM_RC_UNSAFE_SCAN_DELAY
+ #define TERVEL_MEM_RC_UNSAFE_SCAN_DELAY 8
+#endif
+
+// #define TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY
+ // elements which are still watched after a scan are moved to an older
+ // generation, which is only rechecked once every this many scans.
+#ifndef TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY
+ #define TERVEL_MEM_RC_OLD_UNSAFE_SCAN_DELAY 8
+#endif
+
+
+
+// TERVEL Metric MACROS:
+
+// #define TERVEL_METRIC_ENABLED_MASK
+ // with USE_TERVEL_METRICS, the initial bitmask of metrics that are tracked,
+ // it can be changed at runtime through EventTracker::set_enabled_mask,
+ // enable, disable and set_enabled. Defaults to all metrics.
+#ifndef TERVEL_METRIC_ENABLED_MASK
+ #define TERVEL_METRIC_ENABLED_MASK ~0ULL
+#endif
+
+// #define TERVEL_METRIC_EXPORT_INTERVAL_MS
+ // the default interval between exports of a MetricsExporter
+#ifndef TERVEL_METRIC_EXPORT_INTERVAL_MS
+ #define TERVEL_METRIC_EXPORT_INTERVAL_MS 1000
+#endif
+
+// #define TERVEL_METRIC_LATENCY_STEADY_CLOCK
+ // with USE_TERVEL_METRICS, operation latencies are recorded in nanoseconds
+ // from std::chrono::steady_clock instead of cycles from rdtsc.
+
+// #define TERVEL_METRIC_LATENCY_SAMPLE_RATE
+ // with USE_TERVEL_METRICS, the latency of one in every this many operations
+ // is recorded.
+#ifndef TERVEL_METRIC_LATENCY_SAMPLE_RATE
+ #define TERVEL_METRIC_LATENCY_SAMPLE_RATE 1
+#endif
+
+// #define TERVEL_TRACE_ENABLED
+ // with USE_TERVEL_METRICS, events counted by TERVEL_METRIC are also recorded
+ // in a per thread trace ring from the start. Tracing can be turned on and
+ // off at runtime through EventTracker::set_tracing.
+
+// #define TERVEL_TRACE_RING_SIZE
+ // the number of most recent events kept in each thread's trace ring, must be
+ // a power of two.
+#ifndef TERVEL_TRACE_RING_SIZE
+ #define TERVEL_TRACE_RING_SIZE 4096
+#endif
 
 
 // TERVEL Progress Assurance MACROS:
 
 // #define TERVEL_PROG_ASSUR_DELAY
-// sets the delay between calling the check for announcement function
+// sets the default delay between calling the check for announcement function,
+// it can be changed at runtime through ProgressSettings
 #ifndef TERVEL_PROG_ASSUR_DELAY
  #define TERVEL_PROG_ASSUR_DELAY 100000
 #endif
@@ -115,12 +188,53 @@ namespace util {
   #error TERVEL_PROG_ASSUR_NO_CHECK and TERVEL_PROG_ASSUR_ALWAYS_CHECK can not both be set.
 #endif
 
+// #define TERVEL_PROG_ASSUR_HELP_ALL
+  // when checking for announcements, help every announced operation instead
+  // of only the next one
+
 // #define TERVEL_PROG_ASSUR_LIMIT
-  // sets the delay before making an announcement
+  // sets the default delay before making an announcement, it can be changed at
+  // runtime through ProgressSettings
 #ifndef TERVEL_PROG_ASSUR_LIMIT
   #define TERVEL_PROG_ASSUR_LIMIT 100000
 #endif
 
+// #define TERVEL_PROG_ASSUR_ADAPTIVE
+  // sets the Tervel object's progress assurance settings to adaptive mode,
+  // where the limit and delay are adjusted based on how often announced
+  // operations are helped. See ProgressSettings.
+#ifdef TERVEL_PROG_ASSUR_ADAPTIVE
+  #define TERVEL_PROG_ASSUR_ADAPTIVE_DEFAULT true
+#else
+  #define TERVEL_PROG_ASSUR_ADAPTIVE_DEFAULT false
+#endif
+
+// #define TERVEL_PROG_ASSUR_ADAPT_PERIOD
+  // the number of announcements between adjustments in adaptive mode
+#ifndef TERVEL_PROG_ASSUR_ADAPT_PERIOD
+  #define TERVEL_PROG_ASSUR_ADAPT_PERIOD 64
+#endif
+
+// #define TERVEL_PROG_ASSUR_ADAPT_RANGE
+  // in adaptive mode the limit and delay stay within a factor of this of the
+  // values that were last set
+#ifndef TERVEL_PROG_ASSUR_ADAPT_RANGE
+  #define TERVEL_PROG_ASSUR_ADAPT_RANGE 16
+#endif
+
+// #define TERVEL_OP_RECORD_POOL_PREFILL
+  // the number of blocks of each size class a thread's OpRecordPool starts with
+#ifndef TERVEL_OP_RECORD_POOL_PREFILL
+  #define TERVEL_OP_RECORD_POOL_PREFILL 4
+#endif
+
+// #define TERVEL_OP_RECORD_POOL_MAX
+  // the number of blocks of each size class a thread's OpRecordPool keeps,
+  // further blocks are freed
+#ifndef TERVEL_OP_RECORD_POOL_MAX
+  #define TERVEL_OP_RECORD_POOL_MAX 32
+#endif
+
 // #define TERVEL_PROG_ASSUR_NO_ANNOUNCE
   // disables the making of an announcement
   // sets TERVEL_PROG_ASSUR_LIMIT = -1